@@ -15,18 +15,25 @@ isEmpty(OPENSSL_INCLUDE_PATH): OPENSSL_INCLUDE_PATH = /usr/include/openssl /usr/
 
 LIBS += -lssl -lcrypto -lz -lqtelegram-ae -ltelegramqml -lthumbnailer-qt
 
-INCLUDEPATH += $${OPENSSL_INCLUDE_PATH} 
+INCLUDEPATH += $${OPENSSL_INCLUDE_PATH} ../shared
+include(../shared/shared.pri)
 
 SOURCES += main.cpp \
     telegram.cpp \
     emojis.cpp \
+    emojitrie.cpp \
+    emojitext.cpp \
+    emojitheme.cpp \
+    emojithemeindex.cpp \
+    emojiimageprovider.cpp \
     unitysystemtray.cpp \
     compabilitytools.cpp \
     upgradev2.cpp \
     cutegramenums.cpp \
     textemojiwrapper.cpp \
     emoticonsmodel.cpp \
-    stickerfilemanager.cpp
+    stickerfilemanager.cpp \
+    scopeindexer.cpp
 
 include(qmake/qtcAddDeployment.pri)
 include(asemantools/asemantools.pri)
@@ -36,6 +43,11 @@ HEADERS += \
     telegram.h \
     cutegram_macros.h \
     emojis.h \
+    emojitrie.h \
+    emojitext.h \
+    emojitheme.h \
+    emojithemeindex.h \
+    emojiimageprovider.h \
     unitysystemtray.h \
     compabilitytools.h \
     upgradev2.h \
@@ -43,7 +55,12 @@ HEADERS += \
     themeitem.h \
     textemojiwrapper.h \
     emoticonsmodel.h \
-    stickerfilemanager.h
+    stickerfilemanager.h \
+    scopeindexer.h \
+    ../shared/surfacingsnapshot.h \
+    ../shared/peerhints.h \
+    ../shared/prefetchspool.h \
+    ../shared/searchkeys.h
 
 RESOURCES += telegram.qrc
 
@@ -0,0 +1,30 @@
+# Standalone benchmark for the app's emoji text processing, not part of the
+# click package. Build and run it on the device or on the desktop:
+#
+#   mkdir build-bench && cd build-bench && qmake ../bench && make
+#   ./emoji-bench --help
+
+QT -= gui
+CONFIG += console c++11
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = emoji-bench
+
+DEFINES += EMOJIS_THEME_PATH=\\\"$$PWD/../emojis/twitter/theme\\\"
+
+INCLUDEPATH += .. ../../shared
+
+MOC_DIR = mocs
+OBJECTS_DIR = objs
+
+SOURCES += \
+    main.cpp \
+    ../emojitext.cpp \
+    ../emojitrie.cpp \
+    ../emojithemeindex.cpp
+
+HEADERS += \
+    ../../shared/benchoptions.h \
+    ../emojitext.h \
+    ../emojitrie.h \
+    ../emojithemeindex.h
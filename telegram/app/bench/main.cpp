@@ -0,0 +1,354 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QStringList>
+#include <QVariantMap>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "benchoptions.h"
+#include "emojitext.h"
+#include "emojitrie.h"
+#include "emojithemeindex.h"
+
+// Replaces the emoji codes of generated chat messages with <img> tags, once
+// with the old per-position QHash lookups and once with EmojiText, the code
+// Emojis::textToEmojiText() runs, and prints the cost per message. The
+// messages come from a fixed seed: words, emoji, flags and line breaks in
+// roughly the proportions of a group chat. The smiley passes do the same for
+// Emojis::convertSmiliesToEmoji() with the replacements of AccountPage.qml.
+// Before that it compares reading the text theme file with loading its
+// compiled EmojiThemeIndex, in time and in heap used for the codes.
+
+static const char *USAGE =
+    "Usage: emoji-bench [options]\n"
+    "  --messages N     messages per run (2000)\n"
+    "  --words N        average words per message (12)\n"
+    "  --runs N         timed runs (20)\n";
+
+static const char *IMG_START = " <img align=absmiddle height=\"16\" width=\"16\" src=\"";
+static const char *IMG_END = "\" /> ";
+
+static const char *SMILEYS[][2] = { { ":)", "\xF0\x9F\x98\x8C" }, { ":(", "\xF0\x9F\x98\x9E" },
+                                    { ":d", "\xF0\x9F\x98\x81" }, { ":*", "\xF0\x9F\x98\x98" },
+                                    { ":s", "\xF0\x9F\x98\x96" }, { "^_^", "\xF0\x9F\x98\x8A" },
+                                    { ":/", "\xF0\x9F\x98\x95" }, { "B)", "\xF0\x9F\x98\x8E" },
+                                    { ":p", "\xF0\x9F\x98\x8B" }, { ":o", "\xF0\x9F\x98\xAF" },
+                                    { ":x", "\xF0\x9F\x98\x8D" }, { ";)", "\xF0\x9F\x98\x89" },
+                                    { ">:)", "\xF0\x9F\x98\x88" }, { "o:)", "\xF0\x9F\x98\x87" },
+                                    { ":((", "\xF0\x9F\x98\xA2" }, { ":(((", "\xF0\x9F\x98\xAD" },
+                                    { ":))", "\xF0\x9F\x98\x84" }, { ":)))", "\xF0\x9F\x98\x86" },
+                                    { ":))))", "\xF0\x9F\x98\x82" } };
+
+struct Theme
+{
+    QHash<QString,QString> emojis;
+    QStringList keys;
+    QStringList paths;
+    EmojiTrie trie;
+
+    QVariantMap replacements;
+    int minReplacementSize;
+    int maxReplacementSize;
+    EmojiTrie smileys;
+    QStringList smileyEmojis;
+};
+
+static bool readTheme(Theme &theme)
+{
+    QFile file(EMOJIS_THEME_PATH);
+    if(!file.open(QFile::ReadOnly))
+        return false;
+
+    const QStringList lines = QString::fromUtf8(file.readAll()).split("\n", QString::SkipEmptyParts);
+    foreach(const QString &line, lines)
+    {
+        const QStringList parts = line.split("\t", QString::SkipEmptyParts);
+        if(parts.count() < 2)
+            continue;
+
+        // As EmojiImageProvider::source().
+        const QString path = "image://emoji/twitter/" + parts.at(0).section('.', 0, 0);
+        theme.emojis[parts.at(1)] = path;
+        theme.keys << parts.at(1);
+        theme.trie.insert(parts.at(1), theme.paths.size());
+        theme.paths << path;
+    }
+    return !theme.keys.isEmpty();
+}
+
+// Heap of a QString the size of s, as Qt 5 allocates it.
+static qint64 stringBytes(const QString &s)
+{
+    return 24 + 2 * (s.size() + 1);
+}
+
+// As EmojiTheme::open() with an index already in the cache. Returns the
+// heap used, the keys themselves stay in the index.
+static qint64 loadIndex(const QByteArray &index, EmojiTrie &trie, QStringList &keys)
+{
+    const EmojiThemeIndex::Header *header;
+    const EmojiThemeIndex::Entry *entries;
+    const ushort *strings;
+    if(!EmojiThemeIndex::parse(reinterpret_cast<const uchar *>(index.constData()), index.size(), header, entries, strings))
+        return -1;
+
+    for(quint32 i = 0; i < header->count; i++)
+    {
+        const QString key = EmojiThemeIndex::string(header, strings, entries[i].code);
+        keys << key;
+        trie.insert(key, i);
+    }
+    // A list slot and the header fromRawData() allocates, per key.
+    return keys.size() * (8 + 24);
+}
+
+// As Emojis::setReplacements().
+static void readSmileys(Theme &theme)
+{
+    theme.minReplacementSize = 0;
+    theme.maxReplacementSize = 0;
+    for(size_t i = 0; i < sizeof(SMILEYS) / sizeof(SMILEYS[0]); i++)
+    {
+        const QString key = SMILEYS[i][0];
+        theme.replacements[key] = QString::fromUtf8(SMILEYS[i][1]);
+        theme.smileys.insert(key.toLower(), theme.smileyEmojis.size());
+        theme.smileyEmojis << QString::fromUtf8(SMILEYS[i][1]);
+
+        if(!theme.minReplacementSize || key.length() < theme.minReplacementSize)
+            theme.minReplacementSize = key.length();
+        if(key.length() > theme.maxReplacementSize)
+            theme.maxReplacementSize = key.length();
+    }
+}
+
+// Before EmojiTrie: up to four QStrings and lookups per character, and a
+// replace() in place for every emoji.
+static QString legacyPass(const Theme &theme, const QString &txt)
+{
+    QString res = txt;
+    for(int i=0; i<res.size(); i++)
+    {
+        for(int j=1; j<5; j++)
+        {
+            QString emoji = res.mid(i,j);
+            if(!theme.emojis.contains(emoji))
+                continue;
+
+            QString in_txt = QString(IMG_START) + theme.emojis.value(emoji) + IMG_END;
+            res.replace(i,j,in_txt);
+            i += in_txt.size()-1;
+            break;
+        }
+    }
+    return res.replace("\n","<br />");
+}
+
+// What Emojis::textToEmojiText() runs after the hashtags.
+static QString triePass(const Theme &theme, const QString &res)
+{
+    return EmojiText::replaceEmoji(res, theme.trie, theme.paths, IMG_START, IMG_END);
+}
+
+// Before the smiley matcher: every length at every word start, each with a
+// mid(), toLower() and map lookup, and a replace() in place.
+static QString legacySmileys(const Theme &theme, const QString &txt)
+{
+    QString res = txt;
+    for(int i=0; i<res.length()-1; i++)
+    {
+        const QChar currentString = res[i];
+        if(i!=0 && currentString != ' ' && currentString != '\n')
+            continue;
+
+        const int smileyPointer = i==0? i : i+1;
+        for(int j=theme.minReplacementSize; j<=theme.maxReplacementSize; j++)
+        {
+            if(smileyPointer+j < res.length())
+            {
+                const QChar endChar = res[smileyPointer+j];
+                if(endChar != ' ' && endChar != '\n')
+                    continue;
+            }
+
+            const QString &selection = res.mid(smileyPointer, j).toLower();
+            if(!theme.replacements.contains(selection))
+                continue;
+
+            res.replace(smileyPointer, j, theme.replacements.value(selection).toString());
+            i = smileyPointer;
+        }
+    }
+    return res;
+}
+
+// Emojis::convertSmiliesToEmoji().
+static QString matcherSmileys(const Theme &theme, const QString &txt)
+{
+    return EmojiText::replaceSmileys(txt, theme.smileys, theme.smileyEmojis, theme.minReplacementSize,
+                                     theme.maxReplacementSize);
+}
+
+static QStringList generateMessages(const Theme &theme, int count, int words)
+{
+    static const char *WORDS[] = { "ok", "see", "you", "tomorrow", "at", "the", "station", "haha", "that", "was",
+                                   "great", "photo", "can", "someone", "send", "me", "link", "please", "thanks",
+                                   "lol", "where", "are", "we", "meeting", "tonight", "coffee", "is", "ready" };
+    const int wordCount = sizeof(WORDS) / sizeof(WORDS[0]);
+
+    // A few faces make up most of the emoji people send.
+    QStringList common;
+    for(int i = 0; i < theme.keys.size() && common.size() < 20; i++)
+        if(theme.keys.at(i).size() == 2)
+            common << theme.keys.at(i);
+    QStringList flags;
+    foreach(const QString &key, theme.keys)
+        if(key.size() == 4)
+            flags << key;
+
+    qsrand(20160101);
+    QStringList messages;
+    for(int m = 0; m < count; m++)
+    {
+        QString message;
+        const int length = 1 + qrand() % (2 * words);
+        for(int w = 0; w < length; w++)
+        {
+            const int roll = qrand() % 100;
+            if(roll < 8 && !common.isEmpty())
+                message += common.at(qrand() % common.size());
+            else if(roll < 10)
+                message += theme.keys.at(qrand() % theme.keys.size());
+            else if(roll < 11 && !flags.isEmpty())
+                message += flags.at(qrand() % flags.size());
+            else if(roll < 14)
+                message += SMILEYS[qrand() % (sizeof(SMILEYS) / sizeof(SMILEYS[0]))][0];
+            else
+                message += WORDS[qrand() % wordCount];
+            message += roll < 93? " " : roll < 96? "\n" : ", ";
+        }
+        messages << message;
+    }
+    return messages;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    int messageCount = 2000;
+    int words = 12;
+    int runs = 20;
+
+    const int status = BenchOptions::parse(app.arguments(), USAGE, QStringList(),
+                                           [&](const QString &arg, const QString &value) -> bool {
+        if(arg == "--messages") messageCount = qMax(1, value.toInt());
+        else if(arg == "--words") words = qMax(1, value.toInt());
+        else if(arg == "--runs") runs = qMax(1, value.toInt());
+        else return false;
+        return true;
+    });
+    if(status >= 0)
+        return status;
+
+    QElapsedTimer timer;
+    timer.start();
+    Theme theme;
+    if(!readTheme(theme))
+    {
+        fprintf(stderr, "Could not read %s\n", EMOJIS_THEME_PATH);
+        return 1;
+    }
+    const double textMs = timer.nsecsElapsed() / 1e6;
+    readSmileys(theme);
+    printf("theme: %d codes, longest %d code units, read in %.2f ms\n", theme.keys.size(), theme.trie.maxKeyLength(),
+           textMs);
+
+    // The text file as Emojis used to keep it: a key list and a path hash,
+    // leaving out the hash's nodes.
+    qint64 textBytes = 0;
+    foreach(const QString &key, theme.keys)
+        textBytes += 8 + 2 * stringBytes(key) + stringBytes(theme.emojis.value(key));
+
+    QFile themeFile(EMOJIS_THEME_PATH);
+    themeFile.open(QFile::ReadOnly);
+    const QByteArray themeData = themeFile.readAll();
+    timer.restart();
+    const QByteArray index = EmojiThemeIndex::build(themeData, QFileInfo(themeFile).lastModified().toMSecsSinceEpoch());
+    const double buildMs = timer.nsecsElapsed() / 1e6;
+
+    EmojiTrie indexTrie;
+    QStringList indexKeys;
+    timer.restart();
+    const qint64 indexBytes = loadIndex(index, indexTrie, indexKeys);
+    const double indexMs = timer.nsecsElapsed() / 1e6;
+    if(indexBytes < 0 || indexKeys != theme.keys)
+    {
+        fprintf(stderr, "The index does not hold the codes of the theme file\n");
+        return 1;
+    }
+    printf("index: %d bytes, built in %.2f ms, loaded in %.2f ms\n", index.size(), buildMs, indexMs);
+    printf("codes on the heap: %lld bytes from text, %lld bytes from index (without the tries)\n",
+           textBytes, indexBytes);
+
+    const QStringList messages = generateMessages(theme, messageCount, words);
+    qint64 characters = 0;
+    foreach(const QString &message, messages)
+        characters += message.size();
+
+    // Longest match may differ from the old shortest match, only where one
+    // code is the start of another.
+    int differing = 0;
+    foreach(const QString &message, messages)
+        if(legacyPass(theme, message) != triePass(theme, message))
+            differing++;
+
+    // Only where a smiley in capitals used to be missed, like "B)".
+    int smileysDiffering = 0;
+    foreach(const QString &message, messages)
+        if(legacySmileys(theme, message) != matcherSmileys(theme, message))
+            smileysDiffering++;
+
+    static const char *PASSES[] = { "legacy", "trie", "smileys", "matcher" };
+
+    printf("%-8s %10s %10s %10s\n", "pass", "p50 us", "p95 us", "MB/s");
+    for(int pass = 0; pass < 4; pass++)
+    {
+        std::vector<qint64> elapsed;
+        qint64 total = 0;
+        for(int run = 0; run <= runs; run++)
+        {
+            foreach(const QString &message, messages)
+            {
+                timer.restart();
+                QString html;
+                switch(pass)
+                {
+                case 0: html = legacyPass(theme, message); break;
+                case 1: html = triePass(theme, message); break;
+                case 2: html = legacySmileys(theme, message); break;
+                default: html = matcherSmileys(theme, message); break;
+                }
+                const qint64 nsecs = timer.nsecsElapsed();
+                Q_UNUSED(html)
+                if(run == 0)
+                    continue;
+                elapsed.push_back(nsecs);
+                total += nsecs;
+            }
+        }
+
+        std::sort(elapsed.begin(), elapsed.end());
+        printf("%-8s %10.2f %10.2f %10.1f\n", PASSES[pass], BenchOptions::percentile(elapsed, 0.50, 1e3),
+               BenchOptions::percentile(elapsed, 0.95, 1e3), total? characters * 2.0 * runs / (total / 1e9) / 1e6 : 0);
+    }
+    printf("%d of %d messages differ between the emoji passes\n", differing, messages.size());
+    printf("%d of %d messages differ between the smiley passes\n", smileysDiffering, messages.size());
+
+    return 0;
+}
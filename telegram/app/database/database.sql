@@ -32,6 +32,19 @@ CREATE INDEX "Messages.toId_idx" ON "Messages"("toId");
 CREATE INDEX "Messages.fromId_idx" ON "Messages"("fromId");
 CREATE INDEX "Messages.out_idx" ON "Messages"("out");
 CREATE INDEX "Messages.message_idx" ON "Messages"("message");
+CREATE INDEX IF NOT EXISTS "Messages.mediaType_date_idx" ON "Messages"("mediaType", "date");
+CREATE VIRTUAL TABLE IF NOT EXISTS MessagesFts USING fts4(message, tokenize=unicode61);
+CREATE TRIGGER IF NOT EXISTS "Messages.fts_insert" AFTER INSERT ON Messages BEGIN
+    DELETE FROM MessagesFts WHERE docid = new.id;
+    INSERT INTO MessagesFts (docid, message) SELECT new.id, new.message WHERE new.message != '';
+END;
+CREATE TRIGGER IF NOT EXISTS "Messages.fts_update" AFTER UPDATE OF message ON Messages BEGIN
+    DELETE FROM MessagesFts WHERE docid = old.id;
+    INSERT INTO MessagesFts (docid, message) SELECT new.id, new.message WHERE new.message != '';
+END;
+CREATE TRIGGER IF NOT EXISTS "Messages.fts_delete" AFTER DELETE ON Messages BEGIN
+    DELETE FROM MessagesFts WHERE docid = old.id;
+END;
 
 CREATE TABLE IF NOT EXISTS PhotoSizes (
     pid BIGINT NOT NULL,
@@ -106,8 +119,11 @@ CREATE TABLE IF NOT EXISTS Dialogs (
     peerType BIGINT,
     topMessage BIGINT,
     unreadCount BIGINT,
-    encrypted BOOLEAN
+    encrypted BOOLEAN,
+    topMessageDate BIGINT
 );
+CREATE INDEX IF NOT EXISTS "Dialogs.topMessage_idx" ON "Dialogs"("topMessage");
+CREATE INDEX IF NOT EXISTS "Dialogs.topMessageDate_idx" ON "Dialogs"("encrypted", "topMessageDate");
 
 CREATE TABLE IF NOT EXISTS Chats (
     id BIGINT PRIMARY KEY NOT NULL,
@@ -166,3 +182,102 @@ CREATE INDEX "Users.lastName_idx" ON "Users"("lastName");
 CREATE INDEX "Users.username_idx" ON "Users"("username");
 CREATE INDEX "Users.phone_idx" ON "Users"("phone");
 
+CREATE TABLE IF NOT EXISTS DownloadedMedia (
+    peer BIGINT NOT NULL,
+    media TEXT NOT NULL,
+    path TEXT NOT NULL,
+
+    PRIMARY KEY (peer, media)
+);
+
+CREATE TABLE IF NOT EXISTS MediaThumbnails (
+    peer BIGINT NOT NULL,
+    media TEXT NOT NULL,
+    path TEXT NOT NULL,
+
+    PRIMARY KEY (peer, media)
+);
+
+
+CREATE TABLE IF NOT EXISTS PeerSearchKeys (
+    peerType BIGINT NOT NULL,
+    key TEXT NOT NULL,
+    peer BIGINT NOT NULL,
+
+    PRIMARY KEY (peerType, key, peer)
+);
+CREATE TABLE IF NOT EXISTS PeerSearchPending (
+    peerType BIGINT NOT NULL,
+    peer BIGINT NOT NULL,
+
+    PRIMARY KEY (peerType, peer)
+);
+CREATE TRIGGER IF NOT EXISTS "Users.search_insert" AFTER INSERT ON Users BEGIN
+    INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (2645671021, new.id);
+END;
+CREATE TRIGGER IF NOT EXISTS "Users.search_update" AFTER UPDATE OF firstName, lastName ON Users BEGIN
+    INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (2645671021, new.id);
+END;
+CREATE TRIGGER IF NOT EXISTS "Chats.search_insert" AFTER INSERT ON Chats BEGIN
+    INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (3134252475, new.id);
+END;
+CREATE TRIGGER IF NOT EXISTS "Chats.search_update" AFTER UPDATE OF title ON Chats BEGIN
+    INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (3134252475, new.id);
+END;
+
+CREATE TRIGGER IF NOT EXISTS "Dialogs.date_insert" AFTER INSERT ON Dialogs BEGIN
+    UPDATE Dialogs SET topMessageDate = (SELECT date FROM Messages WHERE id = new.topMessage) WHERE peer = new.peer;
+END;
+CREATE TRIGGER IF NOT EXISTS "Dialogs.date_update" AFTER UPDATE OF topMessage ON Dialogs BEGIN
+    UPDATE Dialogs SET topMessageDate = (SELECT date FROM Messages WHERE id = new.topMessage) WHERE peer = new.peer;
+END;
+CREATE TRIGGER IF NOT EXISTS "Messages.dialog_date" AFTER INSERT ON Messages BEGIN
+    UPDATE Dialogs SET topMessageDate = new.date WHERE topMessage = new.id;
+END;
+
+CREATE TABLE IF NOT EXISTS DialogStats (
+    id INTEGER PRIMARY KEY NOT NULL,
+    unreadTotal BIGINT NOT NULL
+);
+INSERT OR IGNORE INTO DialogStats (id, unreadTotal) VALUES (0, 0);
+CREATE TRIGGER IF NOT EXISTS "Dialogs.stats_replace" BEFORE INSERT ON Dialogs BEGIN
+    UPDATE DialogStats SET unreadTotal = unreadTotal - COALESCE((SELECT unreadCount FROM Dialogs WHERE peer = new.peer AND encrypted = 0), 0);
+END;
+CREATE TRIGGER IF NOT EXISTS "Dialogs.stats_insert" AFTER INSERT ON Dialogs WHEN new.encrypted = 0 BEGIN
+    UPDATE DialogStats SET unreadTotal = unreadTotal + COALESCE(new.unreadCount, 0);
+END;
+CREATE TRIGGER IF NOT EXISTS "Dialogs.stats_delete" AFTER DELETE ON Dialogs WHEN old.encrypted = 0 BEGIN
+    UPDATE DialogStats SET unreadTotal = unreadTotal - COALESCE(old.unreadCount, 0);
+END;
+CREATE TRIGGER IF NOT EXISTS "Dialogs.stats_update" AFTER UPDATE OF unreadCount, encrypted ON Dialogs BEGIN
+    UPDATE DialogStats SET unreadTotal = unreadTotal
+        - (CASE WHEN old.encrypted = 0 THEN COALESCE(old.unreadCount, 0) ELSE 0 END)
+        + (CASE WHEN new.encrypted = 0 THEN COALESCE(new.unreadCount, 0) ELSE 0 END);
+END;
+
+CREATE TABLE IF NOT EXISTS RecentMedia (
+    mid BIGINT PRIMARY KEY NOT NULL,
+    date BIGINT NOT NULL,
+    mediaType BIGINT NOT NULL,
+    photo BIGINT,
+    peer BIGINT NOT NULL,
+    media TEXT
+);
+CREATE INDEX IF NOT EXISTS "RecentMedia.date_idx" ON "RecentMedia"("date");
+CREATE INDEX IF NOT EXISTS "RecentMedia.photo_idx" ON "RecentMedia"("photo");
+CREATE TRIGGER IF NOT EXISTS "RecentMedia.trim" AFTER INSERT ON RecentMedia BEGIN
+    DELETE FROM RecentMedia WHERE mid IN (SELECT mid FROM RecentMedia ORDER BY date DESC LIMIT -1 OFFSET 300);
+END;
+CREATE TRIGGER IF NOT EXISTS "Messages.recent_media_insert" AFTER INSERT ON Messages WHEN new.mediaType IN (1032643901, 1540298357) BEGIN
+    INSERT OR REPLACE INTO RecentMedia (mid, date, mediaType, photo, peer, media) VALUES (new.id, new.date, new.mediaType, new.mediaPhoto,
+        CASE WHEN new.toPeerType = 3134252475 OR new.out THEN new.toId ELSE new.fromId END,
+        CASE new.mediaType WHEN 1032643901 THEN (SELECT locationVolumeId || '_' || locationLocalId FROM PhotoSizes
+            WHERE pid = new.mediaPhoto ORDER BY locationLocalId, locationVolumeId LIMIT 1) ELSE CAST(new.mediaVideo AS TEXT) END);
+END;
+CREATE TRIGGER IF NOT EXISTS "Messages.recent_media_delete" AFTER DELETE ON Messages BEGIN
+    DELETE FROM RecentMedia WHERE mid = old.id;
+END;
+CREATE TRIGGER IF NOT EXISTS "PhotoSizes.recent_media" AFTER INSERT ON PhotoSizes BEGIN
+    UPDATE RecentMedia SET media = (SELECT locationVolumeId || '_' || locationLocalId FROM PhotoSizes
+        WHERE pid = new.pid ORDER BY locationLocalId, locationVolumeId LIMIT 1) WHERE photo = new.pid;
+END;
@@ -0,0 +1,156 @@
+#define ATLAS_COLUMNS 32
+#define ATLAS_INDEX_KEY "EmojiThemeIndex"
+
+#include "emojiimageprovider.h"
+#include "emojitheme.h"
+#include "asemantools/asemandevices.h"
+
+#include <QDir>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QSaveFile>
+#include <QStringList>
+#include <QDebug>
+
+static QString themePath(const QString &theme)
+{
+    return AsemanDevices::resourcePath() + "/emojis/" + theme + "/";
+}
+
+static QString nameOf(const QString &file)
+{
+    return file.section('.', 0, 0);
+}
+
+EmojiImageProvider::EmojiImageProvider(const QString &cacheDirectory) :
+    QQuickImageProvider(QQuickImageProvider::Image),
+    mCacheDirectory(cacheDirectory)
+{
+}
+
+QString EmojiImageProvider::source(const QString &theme, const QString &file)
+{
+    return "image://emoji/" + theme + "/" + nameOf(file);
+}
+
+QImage EmojiImageProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    const QString theme = id.section('/', 0, 0);
+    const QString name = id.section('/', 1);
+
+    QImage image;
+    {
+        QMutexLocker locker(&mMutex);
+        const Atlas &themeAtlas = atlas(theme);
+        const int cell = themeAtlas.cells.value(name, -1);
+        if(cell < 0 || themeAtlas.image.isNull())
+            return QImage();
+
+        const int cellSize = themeAtlas.cellSize;
+        image = themeAtlas.image.copy(cell%ATLAS_COLUMNS*cellSize, cell/ATLAS_COLUMNS*cellSize, cellSize, cellSize);
+    }
+
+    if(requestedSize.width() > 0 && requestedSize.height() > 0)
+        image = image.scaled(requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if(size)
+        *size = image.size();
+    return image;
+}
+
+const EmojiImageProvider::Atlas &EmojiImageProvider::atlas(const QString &theme)
+{
+    if(mAtlases.contains(theme))
+        return mAtlases[theme];
+
+    // A missing theme gets an empty atlas too, it is not looked for again.
+    Atlas &atlas = mAtlases[theme];
+    atlas.cellSize = 0;
+
+    // Files and cells come from the theme's index, the same one Emojis
+    // reads, so the text theme file is parsed at most once per process.
+    QSharedPointer<const EmojiTheme> data = EmojiTheme::load(theme);
+    if(!data)
+        return atlas;
+
+    // Cells are numbered in the order files first appear, codes sharing a
+    // file share its cell.
+    QStringList files;
+    for(int i=0; i<data->count(); i++)
+    {
+        if(data->cell(i) != files.size())
+            continue;
+
+        files << data->file(i);
+        atlas.cells[nameOf(files.last())] = data->cell(i);
+    }
+
+    if(load(theme, data->stamp(), files, atlas))
+        return atlas;
+    if(!pack(theme, files, atlas))
+        return atlas;
+
+    atlas.image.setText(ATLAS_INDEX_KEY, data->stamp());
+    QDir().mkpath(mCacheDirectory);
+    QSaveFile file(atlasPath(theme));
+    if(!file.open(QIODevice::WriteOnly) || !atlas.image.save(&file, "PNG") || !file.commit())
+        qDebug() << "EmojiImageProvider: Could not write" << atlasPath(theme);
+
+    return atlas;
+}
+
+bool EmojiImageProvider::load(const QString &theme, const QString &stamp, const QStringList &files, Atlas &atlas) const
+{
+    // The atlas is only good for the index it was packed from, another
+    // index may put the files in other cells. Its stamp is read without
+    // decoding the image.
+    QImageReader reader(atlasPath(theme), "PNG");
+    if(stamp.isEmpty() || reader.text(ATLAS_INDEX_KEY) != stamp)
+        return false;
+
+    const QImage image = reader.read();
+    const int rows = (files.size() + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+    const int cellSize = image.width() / ATLAS_COLUMNS;
+    if(cellSize <= 0 || image.width() != ATLAS_COLUMNS*cellSize || image.height() != rows*cellSize)
+        return false;
+
+    atlas.image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    atlas.cellSize = cellSize;
+    return true;
+}
+
+bool EmojiImageProvider::pack(const QString &theme, const QStringList &files, Atlas &atlas) const
+{
+    const QString path = themePath(theme);
+    const int rows = (files.size() + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+
+    QPainter painter;
+    for(int i=0; i<files.size(); i++)
+    {
+        const QImage image(path + files.at(i));
+        if(image.isNull())
+            continue;
+
+        // The theme's emoji are all of one size, the first one sets it.
+        if(atlas.image.isNull())
+        {
+            atlas.cellSize = qMax(image.width(), image.height());
+            atlas.image = QImage(ATLAS_COLUMNS*atlas.cellSize, rows*atlas.cellSize, QImage::Format_ARGB32_Premultiplied);
+            atlas.image.fill(Qt::transparent);
+            painter.begin(&atlas.image);
+            painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        }
+
+        const int cellSize = atlas.cellSize;
+        painter.drawImage(QRect(i%ATLAS_COLUMNS*cellSize, i/ATLAS_COLUMNS*cellSize, cellSize, cellSize), image);
+    }
+    if(painter.isActive())
+        painter.end();
+
+    return !atlas.image.isNull();
+}
+
+QString EmojiImageProvider::atlasPath(const QString &theme) const
+{
+    return mCacheDirectory + "/" + theme + ".png";
+}
@@ -0,0 +1,47 @@
+#ifndef EMOJIIMAGEPROVIDER_H
+#define EMOJIIMAGEPROVIDER_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QQuickImageProvider>
+#include <QString>
+
+// Serves image://emoji/<theme>/<name> from one atlas per emoji theme, so
+// that a screen full of emoji costs a single PNG decode. The atlas is packed
+// from the theme's files the first time the theme is asked for and kept in
+// the cache directory, along with the stamp of the index it was packed
+// from; later starts read it back while that index is current. Each file
+// goes to the cell its EmojiThemeIndex entries record. The small images handed out
+// are copies of their cells, which Qt Quick uploads into its shared atlas
+// texture.
+
+class EmojiImageProvider : public QQuickImageProvider
+{
+public:
+    EmojiImageProvider(const QString &cacheDirectory);
+
+    // Source of a theme file, as used in QML and in the HTML of Emojis.
+    static QString source(const QString &theme, const QString &file);
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize);
+
+private:
+    struct Atlas
+    {
+        QImage image;
+        QHash<QString,int> cells;   // by name
+        int cellSize;
+    };
+
+    const Atlas &atlas(const QString &theme);
+    bool load(const QString &theme, const QString &stamp, const QStringList &files, Atlas &atlas) const;
+    bool pack(const QString &theme, const QStringList &files, Atlas &atlas) const;
+    QString atlasPath(const QString &theme) const;
+
+    QString mCacheDirectory;
+    QMutex mMutex;
+    QHash<QString,Atlas> mAtlases;
+};
+
+#endif // EMOJIIMAGEPROVIDER_H
@@ -17,31 +17,57 @@
 */
 
 #include "emojis.h"
+#include "emojitrie.h"
+#include "emojitext.h"
+#include "emojitheme.h"
 #include "telegram.h"
 #include <userdata.h>
-#include "asemantools/asemandevices.h"
 #include "asemantools/asemantools.h"
 
-#define EMOJIS_PATH QString( AsemanDevices::resourcePath() + "/emojis/" )
+#define EMOJIS_CACHE_LIMIT (2*1024*1024)
 
+#include <QCache>
 #include <QHash>
-#include <QFile>
 #include <QDebug>
 #include <QPointer>
 
+// A message is converted again each time its delegate is created, the same
+// text gives the same HTML as long as the theme, smileys and user data stay.
+struct EmojisCacheKey
+{
+    QString text;
+    int size;
+    bool skipLinks;
+};
+
+inline bool operator==(const EmojisCacheKey &a, const EmojisCacheKey &b)
+{
+    return a.size == b.size && a.skipLinks == b.skipLinks && a.text == b.text;
+}
+
+inline uint qHash(const EmojisCacheKey &key, uint seed = 0)
+{
+    return qHash(key.text, seed) ^ uint(key.size) ^ (key.skipLinks? 0x80000000 : 0);
+}
+
 class EmojisPrivate
 {
 public:
-    QHash<QString,QString> emojis;
-    QStringList keys;
+    QSharedPointer<const EmojiTheme> data; // shared with the other Emojis
     QString theme;
     QPointer<UserData> userData;
     QVariantMap replacements;
+    EmojiTrie smileys;          // lower case replacements keys
+    QStringList smileyEmojis;   // by smileys value
 
     int minReplacementSize;
     int maxReplacementSize;
 
     bool autoEmojis;
+
+    QCache<EmojisCacheKey,QString> cache;   // cost in bytes of key and result
+    qint64 cacheHits;
+    qint64 cacheMisses;
 };
 
 Emojis::Emojis(QObject *parent) :
@@ -51,37 +77,23 @@ Emojis::Emojis(QObject *parent) :
     p->maxReplacementSize = 0;
     p->minReplacementSize = 0;
     p->autoEmojis = false;
+    p->cache.setMaxCost(EMOJIS_CACHE_LIMIT);
+    p->cacheHits = 0;
+    p->cacheMisses = 0;
+    p->data = EmojiTheme::empty();
 
     setCurrentTheme("twitter");
 }
 
 void Emojis::setCurrentTheme(const QString &theme)
 {
-    QString path = EMOJIS_PATH + theme + "/";
-    QString conf = path + "theme";
-
-    QFile cfile(conf);
-    if( !cfile.open(QFile::ReadOnly) )
+    QSharedPointer<const EmojiTheme> data = EmojiTheme::load(theme);
+    if( !data )
         return;
 
     p->theme = theme;
-    p->emojis.clear();
-    p->keys.clear();
-
-    const QString data = cfile.readAll();
-    const QStringList & list = data.split("\n",QString::SkipEmptyParts);
-    foreach( const QString & l, list )
-    {
-        const QStringList & parts = l.split("\t",QString::SkipEmptyParts);
-        if( parts.count() < 2 )
-            continue;
-
-        QString epath = path + parts.at(0);
-        QString ecode = parts.at(1);
-
-        p->emojis[ecode] = epath;
-        p->keys << ecode;
-    }
+    p->data = data;
+    p->cache.clear();
 
     emit currentThemeChanged();
 }
@@ -102,6 +114,7 @@ void Emojis::setUserData(UserData *userData)
         return;
 
     p->userData = userData;
+    p->cache.clear(); // hits would not add their tags to the new user data
     emit userDataChanged();
 }
 
@@ -113,6 +126,9 @@ void Emojis::setReplacements(const QVariantMap &map)
     p->replacements = map;
     p->maxReplacementSize = 0;
     p->minReplacementSize = 0;
+    p->smileys.clear();
+    p->smileyEmojis.clear();
+    p->cache.clear();
 
     QMapIterator<QString,QVariant> i(p->replacements);
     while(i.hasNext())
@@ -120,6 +136,9 @@ void Emojis::setReplacements(const QVariantMap &map)
         i.next();
         const int length = i.key().length();
 
+        p->smileys.insert(i.key().toLower(), p->smileyEmojis.size());
+        p->smileyEmojis << i.value().toString();
+
         if(!p->maxReplacementSize)
             p->maxReplacementSize = length;
         else
@@ -152,42 +171,39 @@ void Emojis::setAutoEmojis(bool stt)
         return;
 
     p->autoEmojis = stt;
+    p->cache.clear();
     emit autoEmojisChanged();
 }
 
-QString Emojis::convertSmiliesToEmoji(const QString &txt)
+int Emojis::cacheLimit() const
 {
-    QString res = txt;
-    for(int i=0; i<res.length()-1; i++)
-    {
-        const QChar currentString = res[i];
-        if(i!=0 && currentString != ' ' && currentString != '\n')
-            continue;
-
-        const int smileyPointer = i==0? i : i+1;
-        for(int j=p->minReplacementSize; j<=p->maxReplacementSize; j++)
-        {
-            if(smileyPointer+j < res.length())
-            {
-                const QChar endChar = res[smileyPointer+j];
-                if(endChar != ' ' && endChar != '\n')
-                    continue;
-            }
-
-            const QString &selection = res.mid(smileyPointer, j).toLower();
-            if(!p->replacements.contains(selection))
-                continue;
-
-            res.replace(smileyPointer, j, p->replacements.value(selection).toString());
-            i = smileyPointer;
-        }
-    }
+    return p->cache.maxCost();
+}
 
-    return res;
+void Emojis::setCacheLimit(int bytes)
+{
+    if(p->cache.maxCost() == bytes)
+        return;
+
+    p->cache.setMaxCost(bytes);
+    emit cacheLimitChanged();
+}
+
+QString Emojis::convertSmiliesToEmoji(const QString &txt)
+{
+    return EmojiText::replaceSmileys(txt, p->smileys, p->smileyEmojis, p->minReplacementSize, p->maxReplacementSize);
 }
 
 QString Emojis::textToEmojiText(const QString &txt, int size, bool skipLinks)
 {
+    const EmojisCacheKey key = { txt, size, skipLinks };
+    if( const QString *cached = p->cache.object(key) )
+    {
+        p->cacheHits++;
+        return *cached;
+    }
+    p->cacheMisses++;
+
     QString res = p->autoEmojis ? convertSmiliesToEmoji(txt) : txt;
     int pos = 0;
 
@@ -221,25 +237,11 @@ QString Emojis::textToEmojiText(const QString &txt, int size, bool skipLinks)
         pos += atag.size();
     }
 
-    for( int i=0; i<res.size(); i++ )
-    {
-        for( int j=1; j<5; j++ )
-        {
-            QString emoji = res.mid(i,j);
-            if( !p->emojis.contains(emoji) )
-                continue;
-
-            QString path = p->emojis.value(emoji);
-            QString in_txt = QString(" <img align=absmiddle height=\"%2\" width=\"%3\" src=\"" + AsemanDevices::localFilesPrePath() +"%1\" /> ").arg(path).arg(size).arg(size);
-            res.replace(i,j,in_txt);
-            i += in_txt.size()-1;
-            break;
-        }
-    }
-
+    const QString imgStart = QString(" <img align=absmiddle height=\"%1\" width=\"%1\" src=\"").arg(size);
+    const QString out = EmojiText::replaceEmoji(res, p->data->trie(), p->data->sources(), imgStart, "\" /> ");
 
-    res = res.replace("\n","<br />");
-    return res;
+    p->cache.insert(key, new QString(out), int(sizeof(QChar))*(txt.size() + out.size()));
+    return out;
 }
 
 QString Emojis::bodyTextToEmojiText(const QString &txt)
@@ -254,17 +256,36 @@ QString Emojis::bodyTextToEmojiText(const QString &txt)
 
 QList<QString> Emojis::keys() const
 {
-    return p->keys;
+    return p->data->keys();
 }
 
 QString Emojis::pathOf(const QString &key) const
 {
-    return p->emojis.value(key);
+    const int entry = p->data->find(key);
+    return entry < 0? QString() : p->data->path(entry);
+}
+
+QString Emojis::sourceOf(const QString &key) const
+{
+    const int entry = p->data->find(key);
+    return entry < 0? QString() : p->data->source(entry);
+}
+
+QVariantMap Emojis::cacheStatistics() const
+{
+    QVariantMap res;
+    res["hits"] = p->cacheHits;
+    res["misses"] = p->cacheMisses;
+    res["entries"] = p->cache.count();
+    res["bytes"] = p->cache.totalCost();
+    res["limit"] = p->cache.maxCost();
+    return res;
 }
 
-const QHash<QString, QString> &Emojis::emojis() const
+void Emojis::resetCacheStatistics()
 {
-    return p->emojis;
+    p->cacheHits = 0;
+    p->cacheMisses = 0;
 }
 
 Emojis::~Emojis()
@@ -30,6 +30,7 @@ class Emojis : public QObject
     Q_PROPERTY( UserData* userData READ userData WRITE setUserData NOTIFY userDataChanged)
     Q_PROPERTY( QVariantMap replacements READ replacements WRITE setReplacements NOTIFY replacementsChanged)
     Q_PROPERTY( bool autoEmojis READ autoEmojis WRITE setAutoEmojis NOTIFY autoEmojisChanged)
+    Q_PROPERTY( int cacheLimit READ cacheLimit WRITE setCacheLimit NOTIFY cacheLimitChanged)
 
     Q_OBJECT
 public:
@@ -48,6 +49,10 @@ public:
     bool autoEmojis() const;
     void setAutoEmojis(bool stt);
 
+    // Bytes of text kept by the textToEmojiText() cache.
+    int cacheLimit() const;
+    void setCacheLimit(int bytes);
+
     Q_INVOKABLE QString convertSmiliesToEmoji(const QString &text);
 
     Q_INVOKABLE QString textToEmojiText(const QString & txt , int size = 16, bool skipLinks = false);
@@ -55,14 +60,19 @@ public:
 
     Q_INVOKABLE QList<QString> keys() const;
     Q_INVOKABLE QString pathOf( const QString & key ) const;
+    // image://emoji/ source of key, for Image and rich text.
+    Q_INVOKABLE QString sourceOf( const QString & key ) const;
 
-    const QHash<QString,QString> &emojis() const;
+    // hits, misses, entries, bytes and limit of the textToEmojiText() cache.
+    Q_INVOKABLE QVariantMap cacheStatistics() const;
+    Q_INVOKABLE void resetCacheStatistics();
 
 signals:
     void currentThemeChanged();
     void userDataChanged();
     void replacementsChanged();
     void autoEmojisChanged();
+    void cacheLimitChanged();
 
 private:
     EmojisPrivate *p;
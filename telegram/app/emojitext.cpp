@@ -0,0 +1,87 @@
+#include "emojitext.h"
+#include "emojitrie.h"
+
+namespace EmojiText {
+
+QString replaceEmoji(const QString &text, const EmojiTrie &trie, const QStringList &sources,
+                     const QString &imgStart, const QString &imgEnd)
+{
+    // The longest emoji code at each position, so sequences such as flags
+    // are not split into their parts.
+    QString out;
+    const QChar *data = text.constData();
+    const int length = text.size();
+    int start = 0;
+    for( int i=0; i<length; )
+    {
+        int matched;
+        const int value = trie.match(data+i, length-i, matched);
+        if( value < 0 && data[i] != '\n' )
+        {
+            i++;
+            continue;
+        }
+
+        if( out.isNull() )
+            out.reserve(length + length/4);
+        out.append(data+start, i-start);
+        if( value < 0 )
+        {
+            out += "<br />";
+            i++;
+        }
+        else
+        {
+            out += imgStart;
+            out += sources.at(value);
+            out += imgEnd;
+            i += matched;
+        }
+        start = i;
+    }
+
+    if( start == 0 )
+        return text;
+
+    out.append(data+start, length-start);
+    return out;
+}
+
+QString replaceSmileys(const QString &text, const EmojiTrie &smileys, const QStringList &emojis,
+                       int minSize, int maxSize)
+{
+    // Each word is looked up once, in place.
+    QString out;
+    const QChar *data = text.constData();
+    const int length = text.size();
+    int start = 0;
+    for( int wordStart=0; wordStart<length; )
+    {
+        int wordEnd = wordStart;
+        while( wordEnd<length && data[wordEnd] != ' ' && data[wordEnd] != '\n' )
+            wordEnd++;
+
+        const int wordLength = wordEnd - wordStart;
+        int matched = 0;
+        const int value = wordLength < minSize || wordLength > maxSize? -1 :
+                          smileys.match(data+wordStart, wordLength, matched, Qt::CaseInsensitive);
+        if( value >= 0 && matched == wordLength )
+        {
+            if( out.isNull() )
+                out.reserve(length);
+            out.append(data+start, wordStart-start);
+            out += emojis.at(value);
+            start = wordEnd;
+        }
+
+        wordStart = wordEnd + 1;
+    }
+
+    if( start == 0 )
+        return text;
+
+    out.append(data+start, length-start);
+    return out;
+}
+
+}
@@ -0,0 +1,29 @@
+#ifndef EMOJITEXT_H
+#define EMOJITEXT_H
+
+#include <QString>
+#include <QStringList>
+
+class EmojiTrie;
+
+// The text passes of Emojis, apart from the QML object so that emoji-bench
+// times the same code the app runs. Both build their result in one pass and
+// return the text itself, without a copy, when there is nothing to replace.
+
+namespace EmojiText {
+
+// Every emoji of trie in text, longest first, becomes imgStart, its source
+// and imgEnd; line breaks become <br />. sources are by trie value.
+QString replaceEmoji(const QString &text, const EmojiTrie &trie, const QStringList &sources,
+                     const QString &imgStart, const QString &imgEnd);
+
+// Words that are one of the smileys, regardless of case, become their
+// emoji. A word is delimited by the start or end of the text, spaces and
+// line breaks. smileys holds lower case keys, emojis are by its values, and
+// keys are between minSize and maxSize code units long.
+QString replaceSmileys(const QString &text, const EmojiTrie &smileys, const QStringList &emojis,
+                       int minSize, int maxSize);
+
+}
+
+#endif // EMOJITEXT_H
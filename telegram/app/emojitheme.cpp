@@ -0,0 +1,133 @@
+#include "emojitheme.h"
+#include "emojiimageprovider.h"
+#include "asemantools/asemandevices.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QDebug>
+
+static QString cacheDirectory;
+
+EmojiTheme::EmojiTheme() :
+    mHeader(0),
+    mEntries(0),
+    mStrings(0)
+{
+}
+
+void EmojiTheme::setCacheDirectory(const QString &path)
+{
+    cacheDirectory = path;
+}
+
+QSharedPointer<const EmojiTheme> EmojiTheme::load(const QString &theme)
+{
+    // Themes are never dropped: their keys point into the index.
+    static QMutex mutex;
+    static QHash<QString, QSharedPointer<const EmojiTheme> > themes;
+
+    QMutexLocker locker(&mutex);
+    if(themes.contains(theme))
+        return themes.value(theme);
+
+    QSharedPointer<EmojiTheme> res(new EmojiTheme);
+    if(!res->open(theme))
+        return QSharedPointer<const EmojiTheme>();
+
+    themes[theme] = res;
+    return res;
+}
+
+QSharedPointer<const EmojiTheme> EmojiTheme::empty()
+{
+    static QSharedPointer<const EmojiTheme> res(new EmojiTheme);
+    return res;
+}
+
+int EmojiTheme::find(const QString &key) const
+{
+    int length;
+    const int entry = mTrie.match(key.constData(), key.size(), length);
+    return entry >= 0 && length == key.size()? entry : -1;
+}
+
+QString EmojiTheme::file(int entry) const
+{
+    return EmojiThemeIndex::string(mHeader, mStrings, mEntries[entry].file);
+}
+
+QString EmojiTheme::stamp() const
+{
+    return mHeader? EmojiThemeIndex::stamp(mHeader) : QString();
+}
+
+QString EmojiTheme::path(int entry) const
+{
+    return mPath + file(entry);
+}
+
+bool EmojiTheme::open(const QString &theme)
+{
+    mPath = AsemanDevices::resourcePath() + "/emojis/" + theme + "/";
+    const QFileInfo themeInfo(mPath + "theme");
+    const QFileInfo indexInfo(cacheDirectory + "/" + theme + ".index");
+    if(!themeInfo.exists())
+        return false;
+
+    const qint64 themeModified = themeInfo.lastModified().toMSecsSinceEpoch();
+    const uchar *data = 0;
+    qint64 size = 0;
+    if(!cacheDirectory.isEmpty() && indexInfo.exists())
+    {
+        mFile.setFileName(indexInfo.filePath());
+        if(mFile.open(QFile::ReadOnly))
+        {
+            size = mFile.size();
+            data = mFile.map(0, size);
+        }
+    }
+
+    // Compiled again whenever the theme file is not the one the index was
+    // compiled from, whether it is newer or not.
+    if(!EmojiThemeIndex::parse(data, size, mHeader, mEntries, mStrings) ||
+       !EmojiThemeIndex::isFrom(mHeader, themeInfo.size(), themeModified))
+    {
+        mFile.close();
+
+        QFile cfile(themeInfo.filePath());
+        if(!cfile.open(QFile::ReadOnly))
+            return false;
+
+        mData = EmojiThemeIndex::build(cfile.readAll(), themeModified);
+        if(!EmojiThemeIndex::parse(reinterpret_cast<const uchar *>(mData.constData()), mData.size(), mHeader, mEntries, mStrings))
+            return false;
+
+        // Mapped from the next start on.
+        if(cacheDirectory.isEmpty())
+            qDebug() << "EmojiTheme: No cache directory, the index of" << theme << "is not kept";
+        else
+        {
+            QDir().mkpath(indexInfo.path());
+            QSaveFile index(indexInfo.filePath());
+            if(!index.open(QIODevice::WriteOnly) || index.write(mData) != mData.size() || !index.commit())
+                qDebug() << "EmojiTheme: Could not write" << indexInfo.filePath();
+        }
+    }
+
+    for(quint32 i=0; i<mHeader->count; i++)
+    {
+        const QString key = EmojiThemeIndex::string(mHeader, mStrings, mEntries[i].code);
+        const QString file = EmojiThemeIndex::string(mHeader, mStrings, mEntries[i].file);
+
+        mKeys << key;
+        mSources << EmojiImageProvider::source(theme, file);
+        mTrie.insert(key, i);
+    }
+
+    return true;
+}
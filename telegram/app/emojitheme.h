@@ -0,0 +1,63 @@
+#ifndef EMOJITHEME_H
+#define EMOJITHEME_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+#include "emojitrie.h"
+#include "emojithemeindex.h"
+
+// The codes and images of one emoji theme, read from its mapped
+// EmojiThemeIndex. A theme is loaded once per process and shared by every
+// Emojis object, so QML creating another Emojis costs a hash lookup. Never
+// changes after loading.
+
+class EmojiTheme
+{
+public:
+    EmojiTheme();
+
+    // Where indexes are kept, set once before the first load().
+    static void setCacheDirectory(const QString &path);
+
+    // Null when the theme has no theme file.
+    static QSharedPointer<const EmojiTheme> load(const QString &theme);
+    // A theme without emoji, until one is loaded.
+    static QSharedPointer<const EmojiTheme> empty();
+
+    const QStringList &keys() const { return mKeys; }
+    const EmojiTrie &trie() const { return mTrie; }
+
+    // Entry of the whole of key, -1 if it is not an emoji of the theme.
+    int find(const QString &key) const;
+
+    // By entry, as the trie's values.
+    int count() const { return mKeys.size(); }
+    QString file(int entry) const;
+    QString path(int entry) const;
+    const QString &source(int entry) const { return mSources.at(entry); }
+    const QStringList &sources() const { return mSources; }
+    int cell(int entry) const { return mEntries[entry].cell; }
+
+    // Identity of the index, see EmojiThemeIndex::stamp().
+    QString stamp() const;
+
+private:
+    bool open(const QString &theme);
+
+    QString mPath;
+    QFile mFile;
+    QByteArray mData;   // when the index could not be written to the cache
+    const EmojiThemeIndex::Header *mHeader;
+    const EmojiThemeIndex::Entry *mEntries;
+    const ushort *mStrings;
+
+    QStringList mKeys;
+    QStringList mSources;
+    EmojiTrie mTrie;
+};
+
+#endif // EMOJITHEME_H
@@ -0,0 +1,54 @@
+#include "emojithemeindex.h"
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+namespace EmojiThemeIndex {
+
+QByteArray build(const QByteArray &theme, qint64 modified)
+{
+    QVector<Entry> entries;
+    QString strings;
+    QHash<QString,quint32> cells;
+
+    const QStringList &list = QString::fromUtf8(theme).split("\n",QString::SkipEmptyParts);
+    foreach(const QString &l, list)
+    {
+        const QStringList &parts = l.split("\t",QString::SkipEmptyParts);
+        if(parts.count() < 2)
+            continue;
+
+        const QString &file = parts.at(0);
+        const QString &code = parts.at(1);
+        if(!cells.contains(file))
+            cells.insert(file, cells.size());
+
+        Entry entry;
+        entry.code.offset = strings.size();
+        entry.code.size = code.size();
+        strings += code;
+        entry.file.offset = strings.size();
+        entry.file.size = file.size();
+        strings += file;
+        entry.cell = cells.value(file);
+        entries << entry;
+    }
+
+    Header header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.count = entries.size();
+    header.stringsSize = strings.size();
+    header.sourceSize = theme.size();
+    header.sourceModified = modified;
+
+    QByteArray res;
+    res.reserve(sizeof(Header) + entries.size()*sizeof(Entry) + strings.size()*2);
+    res.append(reinterpret_cast<const char *>(&header), sizeof(Header));
+    res.append(reinterpret_cast<const char *>(entries.constData()), entries.size()*sizeof(Entry));
+    res.append(reinterpret_cast<const char *>(strings.constData()), strings.size()*2);
+    return res;
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef EMOJITHEMEINDEX_H
+#define EMOJITHEMEINDEX_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+#include <cstring>
+
+// On-disk layout of <theme>.index, compiled from an emoji theme's text
+// theme file the first time the app loads the theme and kept in the cache
+// directory. It is mapped read-only and its strings are used in place, so
+// loading a theme splits no lines and copies no codes.
+//
+//     Header
+//     Entry[count]         in the order of the theme file
+//     ushort[stringsSize]  UTF-16 codes and file names referenced by the entries
+//
+// Integers are in host byte order, the file never leaves the device. Any
+// change to the layout bumps INDEX_VERSION; readers ignore other versions.
+// The header records the size and modification time of the theme file it
+// was compiled from, an index whose source differs is compiled again.
+
+namespace EmojiThemeIndex {
+
+const char INDEX_MAGIC[4] = { 'T', 'G', 'E', 'I' };
+const quint32 INDEX_VERSION = 2;
+
+struct StringRef {
+    quint32 offset;     // into the string section, in code units
+    quint32 size;       // in code units
+};
+
+struct Header {
+    char magic[4];
+    quint32 version;
+    quint32 count;
+    quint32 stringsSize;
+    qint64 sourceSize;      // of the theme file, in bytes
+    qint64 sourceModified;  // of the theme file, in ms since the epoch
+};
+
+struct Entry {
+    StringRef code;     // the emoji as it appears in text
+    StringRef file;     // image file name in the theme directory
+    quint32 cell;       // slot of the file in the theme's atlas, see EmojiImageProvider
+};
+
+static_assert(sizeof(Header) == 32, "emoji theme index header layout changed");
+static_assert(sizeof(Entry) == 20, "emoji theme index entry layout changed");
+
+// Compiles the contents of a text theme file, file and code separated by a
+// tab on each line. modified is the file's modification time.
+QByteArray build(const QByteArray &theme, qint64 modified);
+
+// Checks a mapped or read file and points into it, false if it is not one of
+// this version or its sizes do not add up.
+inline bool parse(const uchar *data, qint64 size, const Header *&header, const Entry *&entries, const ushort *&strings)
+{
+    if(!data || size < qint64(sizeof(Header)))
+        return false;
+
+    header = reinterpret_cast<const Header *>(data);
+    if(memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header->version != INDEX_VERSION)
+        return false;
+    if(qint64(sizeof(Header)) + qint64(header->count) * qint64(sizeof(Entry)) + qint64(header->stringsSize) * 2 != size)
+        return false;
+
+    entries = reinterpret_cast<const Entry *>(data + sizeof(Header));
+    strings = reinterpret_cast<const ushort *>(entries + header->count);
+    return true;
+}
+
+// Whether the index was compiled from this version of the theme file.
+inline bool isFrom(const Header *header, qint64 sourceSize, qint64 sourceModified)
+{
+    return header->sourceSize == sourceSize && header->sourceModified == sourceModified;
+}
+
+// Identifies the contents of an index: two with the same stamp were
+// compiled alike from the same theme file, so their cells agree.
+inline QString stamp(const Header *header)
+{
+    return QString("%1:%2:%3").arg(header->version).arg(header->sourceSize).arg(header->sourceModified);
+}
+
+// A string of the index without a copy, valid as long as the data is.
+inline QString string(const Header *header, const ushort *strings, const StringRef &ref)
+{
+    // Offsets come from a file, never trust them past the string section.
+    if(ref.size == 0 || ref.offset > header->stringsSize || ref.size > header->stringsSize - ref.offset)
+        return QString();
+    return QString::fromRawData(reinterpret_cast<const QChar *>(strings + ref.offset), ref.size);
+}
+
+}
+
+#endif // EMOJITHEMEINDEX_H
@@ -0,0 +1,89 @@
+#include "emojitrie.h"
+
+#include <algorithm>
+
+static inline ushort unitOf(QChar c, bool fold)
+{
+    return fold? ushort(QChar::toLower(uint(c.unicode()))) : c.unicode();
+}
+
+EmojiTrie::EmojiTrie()
+{
+    clear();
+}
+
+void EmojiTrie::clear()
+{
+    mNodes.clear();
+    mNodes.append(Node());
+    mFirstUnits = QBitArray(0x10000);
+    mMaxKeyLength = 0;
+}
+
+void EmojiTrie::insert(const QString &key, int value)
+{
+    if(key.isEmpty() || value < 0)
+        return;
+
+    int node = 0;
+    for(int i = 0; i < key.size(); i++)
+    {
+        Edge edge = { key.at(i).unicode(), 0 };
+        QVector<Edge> &edges = mNodes[node].edges;
+        QVector<Edge>::iterator it = std::lower_bound(edges.begin(), edges.end(), edge);
+        if(it != edges.end() && it->unit == edge.unit)
+        {
+            node = it->node;
+            continue;
+        }
+
+        edge.node = mNodes.size();
+        edges.insert(it, edge);
+        mNodes.append(Node());
+        node = edge.node;
+    }
+
+    mNodes[node].value = value;
+    mFirstUnits.setBit(key.at(0).unicode());
+    mMaxKeyLength = qMax(mMaxKeyLength, key.size());
+}
+
+int EmojiTrie::match(const QChar *text, int size, int &length, Qt::CaseSensitivity cs) const
+{
+    length = 0;
+    if(size <= 0)
+        return -1;
+
+    const bool fold = cs == Qt::CaseInsensitive;
+    if(!mFirstUnits.testBit(unitOf(text[0], fold)))
+        return -1;
+
+    int value = -1;
+    int node = 0;
+    for(int i = 0; i < size; i++)
+    {
+        node = child(node, unitOf(text[i], fold));
+        if(node < 0)
+            break;
+
+        if(mNodes.at(node).value >= 0)
+        {
+            value = mNodes.at(node).value;
+            length = i + 1;
+        }
+    }
+    return value;
+}
+
+int EmojiTrie::maxKeyLength() const
+{
+    return mMaxKeyLength;
+}
+
+int EmojiTrie::child(int node, ushort unit) const
+{
+    const QVector<Edge> &edges = mNodes.at(node).edges;
+    Edge edge = { unit, 0 };
+    QVector<Edge>::const_iterator it = std::lower_bound(edges.constBegin(), edges.constEnd(), edge);
+    return it != edges.constEnd() && it->unit == unit? it->node : -1;
+}
@@ -0,0 +1,51 @@
+#ifndef EMOJITRIE_H
+#define EMOJITRIE_H
+
+#include <QBitArray>
+#include <QString>
+#include <QVector>
+
+// Emoji codes by UTF-16 code unit, for finding the longest code at each
+// position of a text in one step. Built once per theme; a lookup touches one
+// node per code unit of the match and allocates nothing. Also holds the
+// smileys of Emojis::replacements, matched without regard to case.
+
+class EmojiTrie
+{
+public:
+    EmojiTrie();
+
+    void clear();
+    // value >= 0, a later insert of the same key replaces it.
+    void insert(const QString &key, int value);
+
+    // Value of the longest key that text starts with, -1 without one.
+    // length is set to the key's length in code units. Keys have to be
+    // inserted in lower case to be found with Qt::CaseInsensitive.
+    int match(const QChar *text, int size, int &length, Qt::CaseSensitivity cs = Qt::CaseSensitive) const;
+
+    int maxKeyLength() const;
+
+private:
+    struct Edge
+    {
+        ushort unit;
+        int node;
+        bool operator<(const Edge &other) const { return unit < other.unit; }
+    };
+
+    struct Node
+    {
+        Node() : value(-1) {}
+        QVector<Edge> edges;    // sorted by unit
+        int value;
+    };
+
+    int child(int node, ushort unit) const;
+
+    QVector<Node> mNodes;
+    QBitArray mFirstUnits;      // units any key starts with, rules out most text
+    int mMaxKeyLength;
+};
+
+#endif // EMOJITRIE_H
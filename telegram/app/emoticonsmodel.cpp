@@ -152,7 +152,7 @@ QVariant EmoticonsModel::data(const QModelIndex &index, int role) const
         }
         else
         if(p->emojis)
-            result = QUrl::fromLocalFile(p->emojis->pathOf(id));
+            result = QUrl(p->emojis->sourceOf(id));
         break;
     }
 
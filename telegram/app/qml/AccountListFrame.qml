@@ -23,6 +23,16 @@ Item {
 
     signal codeRequested(variant authCodePage, variant telegram, bool phoneRegistered, int sendCallTimeout, bool resent)
 
+    // Hands the chats of recent push notifications to every account, each
+    // warms the ones that are its own.
+    function prefetchPushedChats() {
+        if (list.count == 0) return;
+        var peers = Cutegram.takePrefetchSpool();
+        if (peers.length == 0) return;
+        for (var i = 0; i < list.count; i++)
+            hash.value(list.at(i)).prefetch(peers);
+    }
+
     function showFirstAccount() {
         if (profiles.count == 0) {
             mainView.showIntro();
@@ -107,6 +117,9 @@ Item {
             if (deletedAccount) {
                 showFirstAccount();
             }
+
+            // Started from a notification, the accounts only exist now.
+            prefetchPushedChats();
         }
     }
 }
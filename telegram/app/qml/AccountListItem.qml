@@ -1,10 +1,12 @@
 import QtQuick 2.4
+import QtQml 2.2
 import QtMultimedia 5.0
 import Ubuntu.Components 1.3
 import Ubuntu.Components.ListItems 1.3 as ListItem
 
 import AsemanTools 1.0
 import TelegramQML 1.0
+import Cutegram 1.0
 
 // Cutegram: AccountFrame.qml
 
@@ -19,6 +21,9 @@ Item {
     property alias telegramObject: telegram
     property alias unreadCount: telegram.unreadCount
 
+    // Chats from push notifications, loaded ahead of the tap: {dialog, photos}
+    property var prefetchedDialogs: []
+
     signal activeRequest()
     signal addParticipantRequest()
     signal codeRequested(variant authCodePage, variant telegram, bool phoneRegistered, int sendCallTimeout, bool resent)
@@ -27,6 +32,10 @@ Item {
         telegram.online = isActive;
     }
 
+    function prefetch(peers) {
+        scope_indexer.prefetch(peers);
+    }
+
     function show() {
         console.log("calling show");
         pageStack.primaryPageSource = dialogs_page_component;
@@ -149,6 +158,76 @@ Item {
         }
     }
 
+    ScopeIndexer {
+        id: scope_indexer
+        telegram: telegram
+
+        onPrefetched: {
+            prefetch_timer.pending.push(peer);
+            prefetch_timer.attempts = 0;
+            prefetch_timer.restart();
+        }
+    }
+
+    // Like open_chat_timer, the dialog only exists once TelegramQML has
+    // loaded the dialogs.
+    Timer {
+        id: prefetch_timer
+
+        property var pending: []
+        property int attempts: 0
+
+        interval: 500
+        repeat: true
+        triggeredOnStart: true
+        onTriggered: {
+            var dialogs = prefetchedDialogs.slice();
+            var waiting = [];
+            var resolved = false;
+            for (var i = 0; i < pending.length; i++) {
+                var dialog = telegram.dialog(pending[i].peer);
+                if (dialog == telegram.nullDialog) {
+                    waiting.push(pending[i]);
+                    continue;
+                }
+                dialogs = dialogs.filter(function(prefetched) { return prefetched.dialog != dialog; });
+                dialogs.push({ dialog: dialog, photos: pending[i].photos });
+                resolved = true;
+            }
+            if (resolved) {
+                prefetchedDialogs = dialogs.slice(-5);
+            }
+
+            pending = waiting;
+            attempts++;
+            if (pending.length == 0 || attempts >= 20) {
+                pending = [];
+                stop();
+            }
+        }
+    }
+
+    // A model per prefetched chat reads its messages into TelegramQML, the
+    // message list finds them there when the chat is opened. Thumbnails of
+    // the photos the indexer found missing are requested once they are in.
+    Instantiator {
+        model: prefetchedDialogs
+        delegate: MessagesModel {
+            telegram: account_list_item.telegramObject
+            dialog: modelData.dialog
+
+            onRefreshingChanged: {
+                if (refreshing) return;
+                for (var i = 0; i < modelData.photos.length; i++) {
+                    var message = account_list_item.telegramObject.message(modelData.photos[i]);
+                    if (message.media && message.media.photo.sizes.first) {
+                        account_list_item.telegramObject.getFile(message.media.photo.sizes.first.location);
+                    }
+                }
+            }
+        }
+    }
+
     Component {
         id: account_code_page_component
 
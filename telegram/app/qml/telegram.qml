@@ -69,6 +69,7 @@ MainView {
         }
 
         if (activeFocus) {
+            account_list.prefetchPushedChats();
             processUri();
             if (!pushClient.registered && Cutegram.pushNotifications) {
                 console.log("push - retrying registration");
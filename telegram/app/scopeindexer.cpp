@@ -0,0 +1,1378 @@
+#define SCOPE_INDEX_VERSION 7
+#define SCOPE_INDEX_KEY "scopeIndexVersion"
+#define SNAPSHOT_DELAY 1000
+#define UPGRADE_RETRY_DELAY 5000
+#define UPGRADE_RETRY_MAX_DELAY 300000
+
+#include "scopeindexer.h"
+#include "accountdatabase.h"
+#include "accountpaths.h"
+#include "peerhints.h"
+#include "searchkeys.h"
+#include "surfacingsnapshot.h"
+
+#include <telegramqml.h>
+#include <telegram/types/messagemedia.h>
+#include <telegram/types/peer.h>
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QImage>
+#include <QImageReader>
+#include <QLockFile>
+#include <QPointer>
+#include <QSaveFile>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+class ScopeIndexerPrivate
+{
+public:
+    QPointer<TelegramQml> telegram;
+    QThread *thread;
+    ScopeIndexerCore *core;
+
+    QFileSystemWatcher *watcher;
+    QTimer *snapshotTimer;
+    QTimer *downloadsTimer;
+    QTimer *upgradeTimer;
+    int upgradeDelay;
+    QStringList pendingPeers;
+    bool pendingAll;
+    QVariantList prefetchPeers;
+
+    QString databasePath;
+    QString downloadsPath;
+    bool ready;
+};
+
+ScopeIndexer::ScopeIndexer(QObject *parent) :
+    QObject(parent)
+{
+    p = new ScopeIndexerPrivate;
+    p->ready = false;
+    p->pendingAll = false;
+
+    p->thread = new QThread(this);
+    p->core = new ScopeIndexerCore();
+    p->core->moveToThread(p->thread);
+
+    connect(p->thread, SIGNAL(finished()), p->core, SLOT(deleteLater()));
+    connect(p->core, SIGNAL(upgraded(QString,int)), SLOT(upgraded(QString,int)), Qt::QueuedConnection);
+    connect(p->core, SIGNAL(prefetched(QString,QVariantMap)), SLOT(corePrefetched(QString,QVariantMap)), Qt::QueuedConnection);
+
+    // TelegramQML writes in many small transactions, the snapshot is only
+    // rewritten once they have stopped for a moment.
+    p->watcher = new QFileSystemWatcher(this);
+    p->snapshotTimer = new QTimer(this);
+    p->snapshotTimer->setSingleShot(true);
+    p->snapshotTimer->setInterval(SNAPSHOT_DELAY);
+    p->downloadsTimer = new QTimer(this);
+    p->downloadsTimer->setSingleShot(true);
+    p->downloadsTimer->setInterval(SNAPSHOT_DELAY);
+
+    // A failed upgrade, mostly SQLITE_BUSY while TelegramQML writes, is
+    // tried again later, each time waiting twice as long.
+    p->upgradeTimer = new QTimer(this);
+    p->upgradeTimer->setSingleShot(true);
+    p->upgradeDelay = UPGRADE_RETRY_DELAY;
+
+    connect(p->watcher, SIGNAL(fileChanged(QString)), SLOT(databaseChanged(QString)));
+    connect(p->watcher, SIGNAL(directoryChanged(QString)), SLOT(downloadsChanged(QString)));
+    connect(p->snapshotTimer, SIGNAL(timeout()), SLOT(snapshotTimeout()));
+    connect(p->downloadsTimer, SIGNAL(timeout()), SLOT(downloadsTimeout()));
+    connect(p->upgradeTimer, SIGNAL(timeout()), SLOT(upgradeTimeout()));
+
+    p->thread->start(QThread::LowestPriority);
+}
+
+void ScopeIndexer::setTelegram(TelegramQml *tg)
+{
+    if(p->telegram == tg)
+        return;
+
+    if(p->telegram)
+        disconnect(p->telegram, SIGNAL(authLoggedInChanged()), this, SLOT(recheck()));
+
+    p->telegram = tg;
+    if(p->telegram)
+        connect(p->telegram, SIGNAL(authLoggedInChanged()), this, SLOT(recheck()), Qt::QueuedConnection);
+
+    recheck();
+    emit telegramChanged();
+}
+
+TelegramQml *ScopeIndexer::telegram() const
+{
+    return p->telegram;
+}
+
+bool ScopeIndexer::ready() const
+{
+    return p->ready;
+}
+
+void ScopeIndexer::prefetch(const QVariantList &peers)
+{
+    // Peers the push helper found no account for are tried by every one.
+    const QString &phoneNumber = p->telegram? p->telegram->phoneNumber() : QString();
+    foreach(const QVariant &peer, peers)
+    {
+        const QString &account = peer.toMap().value("account").toString();
+        if(account.isEmpty() || account == phoneNumber)
+            p->prefetchPeers << peer;
+    }
+
+    if(p->databasePath.isEmpty() || p->prefetchPeers.isEmpty())
+        return;
+
+    QMetaObject::invokeMethod(p->core, "prefetch", Qt::QueuedConnection, Q_ARG(QString, p->databasePath),
+                              Q_ARG(QVariantList, p->prefetchPeers));
+    p->prefetchPeers.clear();
+}
+
+void ScopeIndexer::corePrefetched(const QString &databasePath, const QVariantMap &peer)
+{
+    if(databasePath != p->databasePath)
+        return;
+
+    emit prefetched(peer);
+}
+
+void ScopeIndexer::recheck()
+{
+    if(!p->telegram || !p->telegram->authLoggedIn())
+        return;
+
+    const QString &path = AccountPaths::databasePath(p->telegram->phoneNumber(), p->telegram->configPath());
+    if(path == p->databasePath)
+        return;
+
+    if(!p->watcher->files().isEmpty())
+        p->watcher->removePaths(p->watcher->files());
+    if(!p->watcher->directories().isEmpty())
+        p->watcher->removePaths(p->watcher->directories());
+
+    p->databasePath = path;
+    p->downloadsPath = AccountPaths::downloadsPath(p->telegram->phoneNumber(), p->telegram->downloadPath());
+    p->pendingPeers.clear();
+    p->pendingAll = false;
+    if(p->ready)
+    {
+        p->ready = false;
+        emit readyChanged();
+    }
+
+    p->upgradeTimer->stop();
+    p->upgradeDelay = UPGRADE_RETRY_DELAY;
+    upgradeTimeout();
+    databaseChanged(path);
+    watchDownloads();
+
+    // Taken before the account had logged in.
+    if(!p->prefetchPeers.isEmpty())
+        prefetch(QVariantList());
+}
+
+void ScopeIndexer::upgraded(const QString &databasePath, int version)
+{
+    if(databasePath != p->databasePath)
+        return;
+
+    if(version < SCOPE_INDEX_VERSION)
+    {
+        qWarning() << "ScopeIndexer: upgrade of" << databasePath << "stopped at version" << version
+                   << ", retrying in" << p->upgradeDelay << "ms";
+        p->upgradeTimer->start(p->upgradeDelay);
+        p->upgradeDelay = qMin(p->upgradeDelay * 2, UPGRADE_RETRY_MAX_DELAY);
+        return;
+    }
+
+    p->upgradeDelay = UPGRADE_RETRY_DELAY;
+    if(p->ready)
+        return;
+
+    p->ready = true;
+    emit readyChanged();
+}
+
+void ScopeIndexer::upgradeTimeout()
+{
+    if(p->databasePath.isEmpty())
+        return;
+
+    QMetaObject::invokeMethod(p->core, "upgrade", Qt::QueuedConnection, Q_ARG(QString, p->databasePath),
+                              Q_ARG(QString, p->downloadsPath));
+}
+
+void ScopeIndexer::databaseChanged(const QString &path)
+{
+    Q_UNUSED(path)
+    if(p->databasePath.isEmpty())
+        return;
+
+    // A replaced file drops out of the watcher and the WAL only shows up
+    // once TelegramQML switches to it, so both are looked for every time.
+    QStringList missing;
+    foreach(const QString &file, QStringList() << p->databasePath << p->databasePath + "-wal")
+        if(!p->watcher->files().contains(file) && QFile::exists(file))
+            missing << file;
+    if(!missing.isEmpty())
+        p->watcher->addPaths(missing);
+
+    p->snapshotTimer->start();
+
+    // The downloads directory only shows up with the first download.
+    if(p->watcher->directories().isEmpty())
+        watchDownloads();
+}
+
+void ScopeIndexer::watchDownloads()
+{
+    // One watch on the downloads directory for peers coming and going, one
+    // per peer directory for the files in it. Profile photos and video
+    // thumbnails live in subdirectories and are not tracked.
+    QDir downloads(p->downloadsPath);
+    if(!downloads.exists())
+        return;
+
+    QStringList missing;
+    if(!p->watcher->directories().contains(p->downloadsPath))
+        missing << p->downloadsPath;
+    foreach(const QString &peer, downloads.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        const QString &path = downloads.filePath(peer);
+        if(!p->watcher->directories().contains(path))
+            missing << path;
+    }
+    if(!missing.isEmpty())
+        p->watcher->addPaths(missing);
+}
+
+void ScopeIndexer::downloadsChanged(const QString &path)
+{
+    if(path == p->downloadsPath)
+    {
+        // A peer directory was added or the cache was cleared, only a full
+        // pass finds the rows to drop.
+        p->pendingAll = true;
+        watchDownloads();
+    }
+    else
+    {
+        const QString &peer = QFileInfo(path).fileName();
+        if(!p->pendingPeers.contains(peer))
+            p->pendingPeers << peer;
+    }
+
+    p->downloadsTimer->start();
+}
+
+void ScopeIndexer::downloadsTimeout()
+{
+    if(p->databasePath.isEmpty())
+        return;
+
+    const QStringList peers = p->pendingAll? QStringList() : p->pendingPeers;
+    p->pendingPeers.clear();
+    p->pendingAll = false;
+
+    QMetaObject::invokeMethod(p->core, "syncDownloads", Qt::QueuedConnection, Q_ARG(QString, p->databasePath),
+                              Q_ARG(QString, p->downloadsPath), Q_ARG(QStringList, peers));
+}
+
+void ScopeIndexer::snapshotTimeout()
+{
+    if(p->databasePath.isEmpty())
+        return;
+
+    // Keys first, the snapshot then takes its stamp after their write.
+    QMetaObject::invokeMethod(p->core, "updatePeerSearch", Qt::QueuedConnection, Q_ARG(QString, p->databasePath));
+    QMetaObject::invokeMethod(p->core, "writeSnapshot", Qt::QueuedConnection, Q_ARG(QString, p->databasePath));
+    QMetaObject::invokeMethod(p->core, "writePeerHints", Qt::QueuedConnection, Q_ARG(QString, p->databasePath));
+}
+
+ScopeIndexer::~ScopeIndexer()
+{
+    p->thread->quit();
+    p->thread->wait();
+    delete p;
+}
+
+
+
+ScopeIndexerCore::ScopeIndexerCore(QObject *parent) :
+    QObject(parent),
+    connectionName(QString("scope-indexer-%1").arg(quintptr(this)))
+{
+    // One core per logged in account, each on its own thread.
+}
+
+void ScopeIndexerCore::upgrade(const QString &databasePath, const QString &downloadsPath)
+{
+    // Whatever version is reached is reported, ScopeIndexer retries until
+    // it is SCOPE_INDEX_VERSION.
+    if(!open(databasePath))
+    {
+        emit upgraded(databasePath, 0);
+        return;
+    }
+
+    this->downloadsPath = downloadsPath;
+
+    int current = version();
+    while(current < SCOPE_INDEX_VERSION)
+    {
+        // Schema changes go in one transaction, so TelegramQML never sees a
+        // trigger without the table it writes to. Backfills run in batches
+        // afterwards and are safe to resume if the app is closed meanwhile.
+        db.transaction();
+        bool ok = true;
+        foreach(const QString &sql, migration(current))
+        {
+            QSqlQuery query(db);
+            if(!query.exec(sql))
+            {
+                qCritical() << TAG << "migration" << current << "failed:" << query.lastError().text();
+                ok = false;
+                break;
+            }
+        }
+        if(!ok || !db.commit())
+        {
+            db.rollback();
+            break;
+        }
+
+        if(!backfill(current) || !setVersion(current + 1))
+            break;
+
+        current++;
+        qDebug() << TAG << "upgraded" << databasePath << "to version" << current;
+    }
+
+    emit upgraded(databasePath, current);
+}
+
+bool ScopeIndexerCore::open(const QString &databasePath)
+{
+    if(db.isOpen() && db.databaseName() == databasePath)
+        return true;
+
+    if(!QFile::exists(databasePath))
+    {
+        qDebug() << TAG << "no database yet at" << databasePath;
+        return false;
+    }
+
+    if(!db.isValid())
+        db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.close();
+    return AccountDatabase::open(db, databasePath, AccountDatabase::ReadWrite);
+}
+
+int ScopeIndexerCore::version()
+{
+    QSqlQuery query(db);
+    query.exec("CREATE TABLE IF NOT EXISTS General (gkey TEXT NOT NULL, gvalue TEXT NOT NULL, PRIMARY KEY (gkey))");
+
+    query.prepare("SELECT gvalue FROM General WHERE gkey = :key");
+    query.bindValue(":key", SCOPE_INDEX_KEY);
+    if(!query.exec() || !query.next())
+        return 0;
+
+    return query.value(0).toInt();
+}
+
+bool ScopeIndexerCore::setVersion(int version)
+{
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO General (gkey, gvalue) VALUES (:key, :value)");
+    query.bindValue(":key", SCOPE_INDEX_KEY);
+    query.bindValue(":value", QString::number(version));
+    if(!query.exec())
+    {
+        qCritical() << TAG << "could not store version" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+// Keep in sync with database.sql. Steps are only ever appended.
+QStringList ScopeIndexerCore::migration(int version)
+{
+    QStringList sql;
+    switch(version)
+    {
+    case 0:
+        // Full-text index over message bodies for scope search. It keeps its
+        // own copy of the text instead of pointing at Messages as external
+        // content: Messages is keyed by a BIGINT id rather than the rowid and
+        // is written with INSERT OR REPLACE, which skips delete triggers.
+        sql << "CREATE VIRTUAL TABLE IF NOT EXISTS MessagesFts USING fts4(message, tokenize=unicode61)"
+            << "CREATE TRIGGER IF NOT EXISTS \"Messages.fts_insert\" AFTER INSERT ON Messages BEGIN "
+               "DELETE FROM MessagesFts WHERE docid = new.id; "
+               "INSERT INTO MessagesFts (docid, message) SELECT new.id, new.message WHERE new.message != ''; "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"Messages.fts_update\" AFTER UPDATE OF message ON Messages BEGIN "
+               "DELETE FROM MessagesFts WHERE docid = old.id; "
+               "INSERT INTO MessagesFts (docid, message) SELECT new.id, new.message WHERE new.message != ''; "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"Messages.fts_delete\" AFTER DELETE ON Messages BEGIN "
+               "DELETE FROM MessagesFts WHERE docid = old.id; "
+               "END";
+        break;
+
+    case 1:
+        // Latest photos for the scope's photo surface, newest first.
+        sql << "CREATE INDEX IF NOT EXISTS \"Messages.mediaType_date_idx\" ON Messages (mediaType, date)";
+        break;
+
+    case 2:
+        // Photos and videos present in the downloads directory, by the peer
+        // directory they are in and their file name without extension:
+        // "<volume>_<local>" of the photo size, or the video id.
+        sql << "CREATE TABLE IF NOT EXISTS DownloadedMedia ("
+               "peer BIGINT NOT NULL, "
+               "media TEXT NOT NULL, "
+               "path TEXT NOT NULL, "
+               "PRIMARY KEY (peer, media))";
+        break;
+
+    case 3:
+        // Card-sized copies of downloaded photos, keyed like DownloadedMedia.
+        // The scope draws these in its grids and keeps the original for the
+        // preview.
+        sql << "CREATE TABLE IF NOT EXISTS MediaThumbnails ("
+               "peer BIGINT NOT NULL, "
+               "media TEXT NOT NULL, "
+               "path TEXT NOT NULL, "
+               "PRIMARY KEY (peer, media))";
+        break;
+
+    case 4:
+    {
+        // Folded name words of users and chats for the scope's contact
+        // search, see shared/searchkeys.h. SQLite cannot fold non-ASCII text
+        // itself, so the triggers only queue changed peers in
+        // PeerSearchPending and indexPendingPeers() writes their keys.
+        const qint64 user = static_cast<qint64>(Peer::typePeerUser);
+        const qint64 chat = static_cast<qint64>(Peer::typePeerChat);
+        sql << "CREATE TABLE IF NOT EXISTS PeerSearchKeys ("
+               "peerType BIGINT NOT NULL, "
+               "key TEXT NOT NULL, "
+               "peer BIGINT NOT NULL, "
+               "PRIMARY KEY (peerType, key, peer))"
+            << "CREATE TABLE IF NOT EXISTS PeerSearchPending ("
+               "peerType BIGINT NOT NULL, "
+               "peer BIGINT NOT NULL, "
+               "PRIMARY KEY (peerType, peer))"
+            << QString("CREATE TRIGGER IF NOT EXISTS \"Users.search_insert\" AFTER INSERT ON Users BEGIN "
+                       "INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (%1, new.id); "
+                       "END").arg(user)
+            << QString("CREATE TRIGGER IF NOT EXISTS \"Users.search_update\" AFTER UPDATE OF firstName, lastName ON Users BEGIN "
+                       "INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (%1, new.id); "
+                       "END").arg(user)
+            << QString("CREATE TRIGGER IF NOT EXISTS \"Chats.search_insert\" AFTER INSERT ON Chats BEGIN "
+                       "INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (%1, new.id); "
+                       "END").arg(chat)
+            << QString("CREATE TRIGGER IF NOT EXISTS \"Chats.search_update\" AFTER UPDATE OF title ON Chats BEGIN "
+                       "INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) VALUES (%1, new.id); "
+                       "END").arg(chat)
+            << QString("INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) SELECT %1, id FROM Users").arg(user)
+            << QString("INSERT OR IGNORE INTO PeerSearchPending (peerType, peer) SELECT %1, id FROM Chats").arg(chat);
+        break;
+    }
+
+    case 5:
+    {
+        // Dialogs carry the date of their top message, so the scope reads
+        // them in order off an index instead of joining Messages for every
+        // dialog and sorting. database.sql already has the column.
+        bool hasDate = false;
+        QSqlQuery columns(db);
+        if(columns.exec("PRAGMA table_info(Dialogs)"))
+            while(columns.next())
+                if(columns.value(1).toString() == "topMessageDate")
+                    hasDate = true;
+        if(!hasDate)
+            sql << "ALTER TABLE Dialogs ADD COLUMN topMessageDate BIGINT";
+
+        sql << "UPDATE Dialogs SET topMessageDate = (SELECT date FROM Messages WHERE id = Dialogs.topMessage)"
+            << "CREATE INDEX IF NOT EXISTS \"Dialogs.topMessage_idx\" ON Dialogs (topMessage)"
+            << "CREATE INDEX IF NOT EXISTS \"Dialogs.topMessageDate_idx\" ON Dialogs (encrypted, topMessageDate)"
+            << "CREATE TRIGGER IF NOT EXISTS \"Dialogs.date_insert\" AFTER INSERT ON Dialogs BEGIN "
+               "UPDATE Dialogs SET topMessageDate = (SELECT date FROM Messages WHERE id = new.topMessage) WHERE peer = new.peer; "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"Dialogs.date_update\" AFTER UPDATE OF topMessage ON Dialogs BEGIN "
+               "UPDATE Dialogs SET topMessageDate = (SELECT date FROM Messages WHERE id = new.topMessage) WHERE peer = new.peer; "
+               "END"
+            // The top message may be written after the dialog pointing to it.
+            << "CREATE TRIGGER IF NOT EXISTS \"Messages.dialog_date\" AFTER INSERT ON Messages BEGIN "
+               "UPDATE Dialogs SET topMessageDate = new.date WHERE topMessage = new.id; "
+               "END";
+
+        // Unread messages over all dialogs, kept up to date by the triggers
+        // below rather than summed by every scope query. TelegramQML writes
+        // dialogs with INSERT OR REPLACE, which drops the old row without
+        // running delete triggers, so its count is taken back before insert.
+        sql << "CREATE TABLE IF NOT EXISTS DialogStats ("
+               "id INTEGER PRIMARY KEY NOT NULL, "
+               "unreadTotal BIGINT NOT NULL)"
+            << "INSERT OR REPLACE INTO DialogStats (id, unreadTotal) "
+               "SELECT 0, COALESCE(SUM(unreadCount), 0) FROM Dialogs WHERE encrypted = 0"
+            << "CREATE TRIGGER IF NOT EXISTS \"Dialogs.stats_replace\" BEFORE INSERT ON Dialogs BEGIN "
+               "UPDATE DialogStats SET unreadTotal = unreadTotal - "
+               "COALESCE((SELECT unreadCount FROM Dialogs WHERE peer = new.peer AND encrypted = 0), 0); "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"Dialogs.stats_insert\" AFTER INSERT ON Dialogs WHEN new.encrypted = 0 BEGIN "
+               "UPDATE DialogStats SET unreadTotal = unreadTotal + COALESCE(new.unreadCount, 0); "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"Dialogs.stats_delete\" AFTER DELETE ON Dialogs WHEN old.encrypted = 0 BEGIN "
+               "UPDATE DialogStats SET unreadTotal = unreadTotal - COALESCE(old.unreadCount, 0); "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"Dialogs.stats_update\" AFTER UPDATE OF unreadCount, encrypted ON Dialogs BEGIN "
+               "UPDATE DialogStats SET unreadTotal = unreadTotal "
+               "- (CASE WHEN old.encrypted = 0 THEN COALESCE(old.unreadCount, 0) ELSE 0 END) "
+               "+ (CASE WHEN new.encrypted = 0 THEN COALESCE(new.unreadCount, 0) ELSE 0 END); "
+               "END";
+        break;
+    }
+
+    case 6:
+    {
+        // The last RECENT_MEDIA photo and video messages, by date, with the
+        // peer and file name their download is indexed under in
+        // DownloadedMedia. The scope's photo surface and the snapshot read
+        // these instead of walking every photo ever received for the few
+        // that were downloaded. A photo's sizes may be written after its
+        // message, the name is filled in by the PhotoSizes trigger then.
+        const QString peerSql = QString("CASE WHEN %1.toPeerType = %2 OR %1.out THEN %1.toId ELSE %1.fromId END");
+        const QString mediaSql = QString(
+                "CASE %1.mediaType WHEN %2 THEN (SELECT locationVolumeId || '_' || locationLocalId FROM PhotoSizes "
+                "WHERE pid = %1.mediaPhoto ORDER BY locationLocalId, locationVolumeId LIMIT 1) "
+                "ELSE CAST(%1.mediaVideo AS TEXT) END");
+        const qint64 chat = static_cast<qint64>(Peer::typePeerChat);
+        const qint64 photo = static_cast<qint64>(MessageMedia::typeMessageMediaPhoto);
+        const qint64 video = static_cast<qint64>(MessageMedia::typeMessageMediaVideo);
+
+        sql << "CREATE TABLE IF NOT EXISTS RecentMedia ("
+               "mid BIGINT PRIMARY KEY NOT NULL, "
+               "date BIGINT NOT NULL, "
+               "mediaType BIGINT NOT NULL, "
+               "photo BIGINT, "
+               "peer BIGINT NOT NULL, "
+               "media TEXT)"
+            << "CREATE INDEX IF NOT EXISTS \"RecentMedia.date_idx\" ON RecentMedia (date)"
+            << "CREATE INDEX IF NOT EXISTS \"RecentMedia.photo_idx\" ON RecentMedia (photo)";
+
+        // Both walks are bounded by Messages.mediaType_date_idx.
+        foreach(qint64 mediaType, QList<qint64>() << photo << video)
+            sql << QString("INSERT OR REPLACE INTO RecentMedia (mid, date, mediaType, photo, peer, media) "
+                           "SELECT id, date, mediaType, mediaPhoto, %1, %2 FROM Messages "
+                           "WHERE mediaType = %3 ORDER BY date DESC LIMIT %4")
+                   .arg(peerSql.arg("Messages").arg(chat), mediaSql.arg("Messages").arg(photo))
+                   .arg(mediaType).arg(RECENT_MEDIA);
+
+        sql << QString("DELETE FROM RecentMedia WHERE mid IN "
+                       "(SELECT mid FROM RecentMedia ORDER BY date DESC LIMIT -1 OFFSET %1)").arg(RECENT_MEDIA)
+            << QString("CREATE TRIGGER IF NOT EXISTS \"RecentMedia.trim\" AFTER INSERT ON RecentMedia BEGIN "
+                       "DELETE FROM RecentMedia WHERE mid IN "
+                       "(SELECT mid FROM RecentMedia ORDER BY date DESC LIMIT -1 OFFSET %1); "
+                       "END").arg(RECENT_MEDIA)
+            << QString("CREATE TRIGGER IF NOT EXISTS \"Messages.recent_media_insert\" AFTER INSERT ON Messages "
+                       "WHEN new.mediaType IN (%1, %2) BEGIN "
+                       "INSERT OR REPLACE INTO RecentMedia (mid, date, mediaType, photo, peer, media) "
+                       "VALUES (new.id, new.date, new.mediaType, new.mediaPhoto, %3, %4); "
+                       "END").arg(photo).arg(video).arg(peerSql.arg("new").arg(chat), mediaSql.arg("new").arg(photo))
+            << "CREATE TRIGGER IF NOT EXISTS \"Messages.recent_media_delete\" AFTER DELETE ON Messages BEGIN "
+               "DELETE FROM RecentMedia WHERE mid = old.id; "
+               "END"
+            << "CREATE TRIGGER IF NOT EXISTS \"PhotoSizes.recent_media\" AFTER INSERT ON PhotoSizes BEGIN "
+               "UPDATE RecentMedia SET media = (SELECT locationVolumeId || '_' || locationLocalId FROM PhotoSizes "
+               "WHERE pid = new.pid ORDER BY locationLocalId, locationVolumeId LIMIT 1) WHERE photo = new.pid; "
+               "END";
+        break;
+    }
+    }
+
+    return sql;
+}
+
+bool ScopeIndexerCore::backfill(int version)
+{
+    switch(version)
+    {
+    case 0:
+        return backfillMessageIndex();
+    case 2:
+    case 3:
+        return indexDownloads(downloadsPath, QStringList());
+    case 4:
+        return indexPendingPeers();
+    }
+
+    return true;
+}
+
+bool ScopeIndexerCore::backfillMessageIndex()
+{
+    QSqlQuery range(db);
+    range.prepare("SELECT MAX(id) FROM (SELECT id FROM Messages WHERE id > :from ORDER BY id LIMIT :batch)");
+
+    QSqlQuery insert(db);
+    insert.prepare("INSERT INTO MessagesFts (docid, message) "
+                   "SELECT id, message FROM Messages "
+                   "WHERE id > :from AND id <= :to AND message != '' "
+                   "AND NOT EXISTS (SELECT 1 FROM MessagesFts WHERE docid = Messages.id)");
+
+    qint64 from = LLONG_MIN;
+    forever
+    {
+        range.bindValue(":from", from);
+        range.bindValue(":batch", BACKFILL_BATCH);
+        if(!range.exec() || !range.next())
+        {
+            qCritical() << TAG << "message index backfill failed:" << range.lastError().text();
+            return false;
+        }
+        if(range.value(0).isNull())
+            break;
+
+        const qint64 to = range.value(0).toLongLong();
+        range.finish();
+
+        // Short transactions, so TelegramQML's writes only ever wait for one batch.
+        db.transaction();
+        insert.bindValue(":from", from);
+        insert.bindValue(":to", to);
+        if(!insert.exec() || !db.commit())
+        {
+            qCritical() << TAG << "message index backfill failed:" << insert.lastError().text();
+            db.rollback();
+            return false;
+        }
+
+        from = to;
+    }
+
+    return true;
+}
+
+void ScopeIndexerCore::writeSnapshot(const QString &databasePath)
+{
+    using namespace SurfacingSnapshot;
+
+    // The snapshot reads the upgrade's tables and columns.
+    if(!open(databasePath) || version() < SCOPE_INDEX_VERSION)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Taken before reading, so a write that lands while the snapshot is
+    // built leaves it stale rather than silently missing that write.
+    const qint64 sourceModified = databaseModified(QFile::encodeName(databasePath));
+
+    // Same columns from both queries. The peer is the one a card is shown
+    // under: the chat, or the other side of a private conversation.
+    const QString photoSizeSql =
+            "LEFT JOIN PhotoSizes AS photoSize ON photoSize.rowid = "
+            "(SELECT rowid FROM PhotoSizes WHERE pid = m.mediaPhoto ORDER BY locationLocalId, locationVolumeId LIMIT 1) ";
+    const QString fileSql = QString(
+            "LEFT JOIN DownloadedMedia AS file ON file.peer = "
+            "(CASE WHEN m.toPeerType = %1 OR m.out THEN m.toId ELSE m.fromId END) "
+            "AND file.media = (CASE m.mediaType WHEN %2 THEN photoSize.locationVolumeId || '_' || photoSize.locationLocalId "
+            "WHEN %3 THEN CAST(m.mediaVideo AS TEXT) END) ")
+            .arg(static_cast<qint64>(Peer::typePeerChat))
+            .arg(static_cast<qint64>(MessageMedia::typeMessageMediaPhoto))
+            .arg(static_cast<qint64>(MessageMedia::typeMessageMediaVideo));
+    const QString thumbSql =
+            "LEFT JOIN MediaThumbnails AS thumb ON thumb.peer = file.peer AND thumb.media = file.media ";
+    const QString peerColumnsSql = QString(
+            "COALESCE(c.id, u.id) IS NOT NULL AS known, "
+            "COALESCE(c.title, u.firstName) AS firstName, u.lastName AS lastName, u.phone AS phone, "
+            "COALESCE(c.photoSmallVolumeId, u.photoSmallVolumeId) AS avatarVolume, "
+            "COALESCE(c.photoSmallLocalId, u.photoSmallLocalId) AS avatarLocal, "
+            "m.id IS NOT NULL AS hasMessage, m.id AS mid, m.date AS date, m.out AS out, m.unread AS unread, "
+            "m.message AS message, m.mediaType AS mediaType, m.mediaVideo AS vid, "
+            "%1 AS photo, "
+            "file.path AS file, thumb.path AS thumb ");
+
+    QSqlQuery dialogs(db);
+    dialogs.setForwardOnly(true);
+    dialogs.prepare("SELECT d.peer AS peer, d.peerType != :user AS chat, d.unreadCount AS unreadCount, " +
+                    peerColumnsSql.arg("photoSize.locationVolumeId || '_' || photoSize.locationLocalId") +
+                    "FROM Dialogs AS d "
+                    "LEFT JOIN Messages AS m ON m.id = d.topMessage " + photoSizeSql + fileSql + thumbSql +
+                    "LEFT JOIN Users AS u ON d.peerType = :user AND u.id = d.peer "
+                    "LEFT JOIN Chats AS c ON d.peerType != :user AND c.id = d.peer "
+                    "WHERE d.encrypted = 0 ORDER BY d.topMessageDate DESC LIMIT :limit");
+    dialogs.bindValue(":user", static_cast<qint64>(Peer::typePeerUser));
+    dialogs.bindValue(":limit", SNAPSHOT_DIALOGS);
+
+    QSqlQuery photos(db);
+    photos.setForwardOnly(true);
+    // Photos come from RecentMedia, which already has their download key,
+    // so only the last RECENT_MEDIA are ever looked at.
+    photos.prepare("SELECT r.peer AS peer, m.toPeerType = :chat AS chat, 0 AS unreadCount, " + peerColumnsSql.arg("r.media") +
+                   "FROM RecentMedia AS r CROSS JOIN Messages AS m ON m.id = r.mid "
+                   "LEFT JOIN DownloadedMedia AS file ON file.peer = r.peer AND file.media = r.media " + thumbSql +
+                   "LEFT JOIN Users AS u ON m.toPeerType != :chat AND u.id = r.peer "
+                   "LEFT JOIN Chats AS c ON m.toPeerType = :chat AND c.id = r.peer "
+                   "WHERE r.mediaType = :mediaType AND file.path IS NOT NULL ORDER BY r.date DESC LIMIT :limit");
+    photos.bindValue(":chat", static_cast<qint64>(Peer::typePeerChat));
+    photos.bindValue(":mediaType", static_cast<qint64>(MessageMedia::typeMessageMediaPhoto));
+    photos.bindValue(":limit", SNAPSHOT_PHOTOS);
+
+    QByteArray entries;
+    QByteArray strings;
+    const int dialogCount = readSnapshotEntries(dialogs, entries, strings);
+    const int photoCount = dialogCount < 0 ? -1 : readSnapshotEntries(photos, entries, strings);
+    if(photoCount < 0)
+        return;
+
+    QSqlQuery stats(db);
+    if(!stats.exec("SELECT unreadTotal FROM DialogStats WHERE id = 0") || !stats.next())
+    {
+        qCritical() << TAG << "could not read snapshot data" << stats.lastError().text();
+        return;
+    }
+    const quint32 unreadTotal = stats.value(0).toUInt();
+    stats.finish();
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.sourceModified = sourceModified;
+    header.written = QDateTime::currentMSecsSinceEpoch();
+    header.dialogCount = dialogCount;
+    header.dialogLimit = SNAPSHOT_DIALOGS;
+    header.photoCount = photoCount;
+    header.photoLimit = SNAPSHOT_PHOTOS;
+    header.stringsSize = strings.size();
+    header.unreadTotal = unreadTotal;
+
+    // Written aside and renamed over the old one, the scope either maps the
+    // previous snapshot or this one, never a partial file.
+    QSaveFile file(QFileInfo(databasePath).absolutePath() + "/" + SNAPSHOT_FILE_NAME);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCritical() << TAG << "could not write snapshot" << file.errorString();
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(entries);
+    file.write(strings);
+    if(!file.commit())
+    {
+        qCritical() << TAG << "could not write snapshot" << file.errorString();
+        return;
+    }
+
+    qDebug() << TAG << "snapshot with" << dialogCount << "dialogs and" << photoCount << "photos written in" << timer.elapsed() << "ms";
+}
+
+int ScopeIndexerCore::readSnapshotEntries(QSqlQuery &query, QByteArray &entries, QByteArray &strings)
+{
+    using namespace SurfacingSnapshot;
+
+    if(!query.exec())
+    {
+        qCritical() << TAG << "could not read snapshot data" << query.lastError().text();
+        return -1;
+    }
+
+    auto string = [&strings](const QVariant &value) {
+        const QByteArray utf8 = value.toString().toUtf8();
+        StringRef ref;
+        ref.offset = strings.size();
+        ref.size = utf8.size();
+        strings += utf8;
+        return ref;
+    };
+
+    const QSqlRecord record = query.record();
+    int count = 0;
+    while(query.next())
+    {
+        Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.peerId = query.value(record.indexOf("peer")).toLongLong();
+        entry.unreadCount = query.value(record.indexOf("unreadCount")).toUInt();
+
+        if(query.value(record.indexOf("chat")).toBool())
+            entry.flags |= EntryChat;
+        if(query.value(record.indexOf("known")).toBool())
+        {
+            entry.flags |= EntryPeer;
+            entry.firstName = string(query.value(record.indexOf("firstName")));
+            entry.lastName = string(query.value(record.indexOf("lastName")));
+            entry.phone = string(query.value(record.indexOf("phone")));
+
+            const qint64 volumeId = query.value(record.indexOf("avatarVolume")).toLongLong();
+            const qint64 localId = query.value(record.indexOf("avatarLocal")).toLongLong();
+            if(volumeId != 0 || localId != 0)
+                entry.avatar = string(QString("%1_%2").arg(volumeId).arg(localId));
+        }
+
+        if(query.value(record.indexOf("hasMessage")).toBool())
+        {
+            entry.flags |= EntryMessage;
+            entry.messageId = query.value(record.indexOf("mid")).toLongLong();
+            entry.date = query.value(record.indexOf("date")).toLongLong();
+            entry.mediaType = query.value(record.indexOf("mediaType")).toUInt();
+            if(query.value(record.indexOf("out")).toBool())
+                entry.flags |= EntryOut;
+            if(query.value(record.indexOf("unread")).toBool())
+                entry.flags |= EntryUnread;
+
+            entry.text = string(query.value(record.indexOf("message")));
+            entry.photo = string(query.value(record.indexOf("photo")));
+            entry.video = string(query.value(record.indexOf("vid")));
+            entry.file = string(query.value(record.indexOf("file")));
+            entry.thumb = string(query.value(record.indexOf("thumb")));
+        }
+
+        entries.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        count++;
+    }
+    query.finish();
+
+    return count;
+}
+
+void ScopeIndexerCore::writePeerHints(const QString &databasePath)
+{
+    using namespace PeerHints;
+
+    if(!open(databasePath) || version() < SCOPE_INDEX_VERSION)
+        return;
+
+    QDir accountDir = QFileInfo(databasePath).dir();
+    const QString account = accountDir.dirName();
+    accountDir.cdUp();
+    const QString path = accountDir.filePath(HINTS_FILE_NAME);
+
+    // Every dialog peer of this account, as peer, name and avatar; the
+    // avatar only once it is downloaded.
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT d.peer, d.peerType = :user, COALESCE(c.title, TRIM(COALESCE(u.firstName, '') || ' ' || COALESCE(u.lastName, ''))), "
+                  "COALESCE(c.photoSmallVolumeId, u.photoSmallVolumeId), COALESCE(c.photoSmallLocalId, u.photoSmallLocalId) "
+                  "FROM Dialogs AS d "
+                  "LEFT JOIN Users AS u ON d.peerType = :user AND u.id = d.peer "
+                  "LEFT JOIN Chats AS c ON d.peerType != :user AND c.id = d.peer "
+                  "WHERE d.encrypted = 0 ORDER BY d.peer");
+    query.bindValue(":user", static_cast<qint64>(Peer::typePeerUser));
+    if(!query.exec())
+    {
+        qCritical() << TAG << "could not read peer hints" << query.lastError().text();
+        return;
+    }
+
+    // peer, type, name and avatar, four items per peer
+    QStringList hints;
+    while(query.next())
+    {
+        const QString peer = query.value(0).toString();
+        const PeerType type = query.value(1).toBool()? PEER_USER : PEER_CHAT;
+        const qint64 volumeId = query.value(3).toLongLong();
+        const qint64 localId = query.value(4).toLongLong();
+        QString avatar;
+        if(volumeId != 0 || localId != 0)
+        {
+            avatar = QString("%1/%2/profile/%3_%4.jpeg").arg(downloadsPath).arg(peer).arg(volumeId).arg(localId);
+            if(!QFile::exists(avatar))
+                avatar.clear();
+        }
+        hints << peer << QString::number(type) << query.value(2).toString() << avatar;
+    }
+    query.finish();
+
+    // The database settles often, the file only changes with a name or an
+    // avatar.
+    if(hints == peerHints && QFile::exists(path))
+        return;
+
+    // All accounts share the file, each replaces its own entries under the
+    // lock and keeps the others'.
+    QLockFile lock(path + ".lock");
+    if(!lock.tryLock(1000))
+    {
+        qCritical() << TAG << "could not lock" << path;
+        return;
+    }
+
+    struct Hint
+    {
+        quint32 peerType;
+        qint64 peerId;
+        QString account;
+        QString name;
+        QString avatar;
+        bool operator<(const Hint &other) const
+        {
+            if(peerType != other.peerType)
+                return peerType < other.peerType;
+            return peerId != other.peerId? peerId < other.peerId : account < other.account;
+        }
+    };
+    QList<Hint> entries;
+    for(int i = 0; i + 3 < hints.size(); i += 4)
+    {
+        Hint hint = { hints[i + 1].toUInt(), hints[i].toLongLong(), account, hints[i + 2], hints[i + 3] };
+        entries << hint;
+    }
+
+    QFile existing(path);
+    if(existing.open(QIODevice::ReadOnly))
+    {
+        const QByteArray data = existing.readAll();
+        existing.close();
+
+        const Header *header;
+        const Entry *oldEntries;
+        const char *strings;
+        if(parse(reinterpret_cast<const uchar *>(data.constData()), data.size(), header, oldEntries, strings))
+            for(quint32 i = 0; i < header->count; i++)
+            {
+                const QString other = string(header, strings, oldEntries[i].account);
+                if(other == account)
+                    continue;
+
+                Hint hint = { oldEntries[i].peerType, oldEntries[i].peerId, other, string(header, strings, oldEntries[i].name),
+                              string(header, strings, oldEntries[i].avatar) };
+                entries << hint;
+            }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    QByteArray entryData;
+    QByteArray strings;
+    QHash<QString, StringRef> written;
+    auto addString = [&strings, &written](const QString &value) {
+        StringRef ref = { 0, 0 };
+        if(value.isEmpty())
+            return ref;
+        if(written.contains(value))
+            return written.value(value);
+
+        const QByteArray utf8 = value.toUtf8();
+        ref.offset = strings.size();
+        ref.size = utf8.size();
+        strings += utf8;
+        written.insert(value, ref);
+        return ref;
+    };
+    foreach(const Hint &hint, entries)
+    {
+        Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.peerType = hint.peerType;
+        entry.peerId = hint.peerId;
+        entry.account = addString(hint.account);
+        entry.name = addString(hint.name);
+        entry.avatar = addString(hint.avatar);
+        entryData.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HINTS_MAGIC, sizeof(header.magic));
+    header.version = HINTS_VERSION;
+    header.count = entries.size();
+    header.stringsSize = strings.size();
+
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCritical() << TAG << "could not write peer hints" << file.errorString();
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(entryData);
+    file.write(strings);
+    if(!file.commit())
+    {
+        qCritical() << TAG << "could not write peer hints" << file.errorString();
+        return;
+    }
+
+    peerHints = hints;
+}
+
+void ScopeIndexerCore::prefetch(const QString &databasePath, const QVariantList &peers)
+{
+    if(!open(databasePath))
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The page TelegramQML reads when the chat is opened, so it is in the
+    // page cache by then, together with the photos in it that are not
+    // downloaded yet; the key is the one writeSnapshot() looks up.
+    const QString sql =
+            "SELECT m.id, m.mediaType = :photo AND file.path IS NULL FROM "
+            "(SELECT id, date, mediaType, mediaPhoto FROM Messages WHERE %1 ORDER BY date DESC LIMIT :limit) AS m "
+            "LEFT JOIN PhotoSizes AS photoSize ON photoSize.rowid = "
+            "(SELECT rowid FROM PhotoSizes WHERE pid = m.mediaPhoto ORDER BY locationLocalId, locationVolumeId LIMIT 1) "
+            "LEFT JOIN DownloadedMedia AS file ON file.peer = :peer "
+            "AND file.media = photoSize.locationVolumeId || '_' || photoSize.locationLocalId "
+            "ORDER BY m.date DESC";
+
+    foreach(const QVariant &value, peers)
+    {
+        const QVariantMap &peer = value.toMap();
+        const bool chat = peer.value("chat").toBool();
+
+        // Each side of a private chat on its own index.
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare(sql.arg(chat? "toId = :peer AND toPeerType = :chat"
+                                  : "(toId = :peer AND out OR fromId = :peer AND NOT out) AND toPeerType != :chat"));
+        query.bindValue(":photo", static_cast<qint64>(MessageMedia::typeMessageMediaPhoto));
+        query.bindValue(":peer", peer.value("peer").toLongLong());
+        query.bindValue(":chat", static_cast<qint64>(Peer::typePeerChat));
+        query.bindValue(":limit", PREFETCH_MESSAGES);
+        if(!query.exec())
+        {
+            qCritical() << TAG << "could not prefetch" << query.lastError().text();
+            return;
+        }
+
+        QVariantList photos;
+        int messages = 0;
+        while(query.next())
+        {
+            messages++;
+            if(query.value(1).toBool())
+                photos << query.value(0);
+        }
+        query.finish();
+
+        QVariantMap result = peer;
+        result["photos"] = photos;
+        emit prefetched(databasePath, result);
+
+        qDebug() << TAG << "prefetched" << messages << "messages of" << peer.value("peer").toLongLong() << "in" << timer.elapsed() << "ms";
+    }
+}
+
+void ScopeIndexerCore::updatePeerSearch(const QString &databasePath)
+{
+    if(!open(databasePath) || version() < SCOPE_INDEX_VERSION)
+        return;
+
+    indexPendingPeers();
+}
+
+bool ScopeIndexerCore::indexPendingPeers()
+{
+    const qint64 user = static_cast<qint64>(Peer::typePeerUser);
+    const qint64 chat = static_cast<qint64>(Peer::typePeerChat);
+
+    QSqlQuery pending(db);
+    pending.setForwardOnly(true);
+    pending.prepare("SELECT p.peerType AS peerType, p.peer AS peer, "
+                    "CASE WHEN p.peerType = :user THEN COALESCE(u.firstName, '') || ' ' || COALESCE(u.lastName, '') ELSE c.title END AS name "
+                    "FROM PeerSearchPending AS p "
+                    "LEFT JOIN Users AS u ON p.peerType = :user AND u.id = p.peer "
+                    "LEFT JOIN Chats AS c ON p.peerType = :chat AND c.id = p.peer "
+                    "LIMIT :batch");
+
+    QSqlQuery remove(db);
+    remove.prepare("DELETE FROM PeerSearchKeys WHERE peerType = :peerType AND peer = :peer");
+    QSqlQuery insert(db);
+    insert.prepare("INSERT OR IGNORE INTO PeerSearchKeys (peerType, key, peer) VALUES (:peerType, :key, :peer)");
+    QSqlQuery done(db);
+    done.prepare("DELETE FROM PeerSearchPending WHERE peerType = :peerType AND peer = :peer");
+
+    QElapsedTimer timer;
+    timer.start();
+    int count = 0;
+    forever
+    {
+        // Names are read in the same transaction that clears their pending
+        // rows, a rename committed in between makes the commit fail instead
+        // of getting lost. The peers stay pending for the next pass then.
+        db.transaction();
+        pending.bindValue(":user", user);
+        pending.bindValue(":chat", chat);
+        pending.bindValue(":batch", BACKFILL_BATCH);
+        if(!pending.exec())
+        {
+            qCritical() << TAG << "could not index peers:" << pending.lastError().text();
+            db.rollback();
+            return false;
+        }
+
+        QList<qint64> peerTypes;
+        QList<qint64> peers;
+        QStringList names;
+        while(pending.next())
+        {
+            peerTypes << pending.value(0).toLongLong();
+            peers << pending.value(1).toLongLong();
+            names << pending.value(2).toString();
+        }
+        pending.finish();
+
+        const int batch = peers.count();
+        bool ok = true;
+        for(int i = 0; ok && i < batch; i++)
+        {
+            const qint64 peerType = peerTypes.at(i);
+            const qint64 peer = peers.at(i);
+
+            remove.bindValue(":peerType", peerType);
+            remove.bindValue(":peer", peer);
+            ok = remove.exec();
+
+            // A deleted peer just loses its keys.
+            foreach(const QString &key, SearchKeys::keys(names.at(i)))
+            {
+                if(!ok)
+                    break;
+                insert.bindValue(":peerType", peerType);
+                insert.bindValue(":key", key);
+                insert.bindValue(":peer", peer);
+                ok = insert.exec();
+            }
+
+            done.bindValue(":peerType", peerType);
+            done.bindValue(":peer", peer);
+            ok = ok && done.exec();
+        }
+
+        if(!ok || !db.commit())
+        {
+            qCritical() << TAG << "could not index peers:" << remove.lastError().text() << insert.lastError().text()
+                        << done.lastError().text() << db.lastError().text();
+            db.rollback();
+            return false;
+        }
+
+        count += batch;
+        if(batch < BACKFILL_BATCH)
+            break;
+    }
+
+    if(count > 0)
+        qDebug() << TAG << "indexed names of" << count << "peers in" << timer.elapsed() << "ms";
+    return true;
+}
+
+void ScopeIndexerCore::syncDownloads(const QString &databasePath, const QString &downloadsPath, const QStringList &peers)
+{
+    // Before the upgrade the table is not there, and the upgrade itself
+    // indexes everything.
+    if(!open(databasePath) || version() < SCOPE_INDEX_VERSION)
+        return;
+
+    indexDownloads(downloadsPath, peers);
+}
+
+bool ScopeIndexerCore::indexDownloads(const QString &downloadsPath, const QStringList &peers)
+{
+    if(downloadsPath.isEmpty())
+        return true;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir downloads(downloadsPath);
+    // Next to downloads rather than in it, so writing a thumbnail does not
+    // wake the watcher on the peer directory.
+    QDir thumbnails(QFileInfo(downloadsPath).absolutePath() + "/cards");
+    const bool all = peers.isEmpty();
+    const QStringList &dirs = all? downloads.entryList(QDir::Dirs | QDir::NoDotAndDotDot) : peers;
+
+    // Files are looked at and thumbnails written before the transaction,
+    // decoding photos must not hold the database's write lock.
+    QList<qint64> peerIds;
+    QList<QStringList> media;
+    QList<QStringList> paths;
+    QList<QStringList> thumbnailMedia;
+    QList<QStringList> thumbnailPaths;
+    foreach(const QString &dir, dirs)
+    {
+        bool ok;
+        const qint64 peer = dir.toLongLong(&ok);
+        if(!ok)
+            continue;
+
+        thumbnails.mkpath(dir);
+        const QDir peerThumbnails(thumbnails.filePath(dir));
+        QStringList peerMedia, peerPaths, peerThumbnailMedia, peerThumbnailPaths, thumbnailFiles;
+
+        const QFileInfoList &files = QDir(downloads.filePath(dir)).entryInfoList(QStringList() << "*.jpeg" << "*.jpg" << "*.mp4", QDir::Files);
+        foreach(const QFileInfo &file, files)
+        {
+            // Skips video thumbnails such as "<id>.mp4.jpg".
+            const QString &name = file.completeBaseName();
+            if(name.contains('.'))
+                continue;
+
+            peerMedia << name;
+            peerPaths << file.absoluteFilePath();
+            if(file.suffix() == "mp4")
+                continue;
+
+            thumbnailFiles << name + ".jpeg";
+            const QString &thumbnail = writeThumbnail(file, peerThumbnails.filePath(name + ".jpeg"));
+            if(thumbnail.isEmpty())
+                continue;
+
+            peerThumbnailMedia << name;
+            peerThumbnailPaths << thumbnail;
+        }
+
+        // Thumbnails of photos that were deleted since.
+        foreach(const QString &name, peerThumbnails.entryList(QDir::Files))
+            if(!thumbnailFiles.contains(name))
+                QFile::remove(peerThumbnails.filePath(name));
+
+        peerIds << peer;
+        media << peerMedia;
+        paths << peerPaths;
+        thumbnailMedia << peerThumbnailMedia;
+        thumbnailPaths << peerThumbnailPaths;
+    }
+
+    QSqlQuery remove(db);
+    remove.prepare(all? "DELETE FROM DownloadedMedia" : "DELETE FROM DownloadedMedia WHERE peer = :peer");
+    QSqlQuery removeThumbnails(db);
+    removeThumbnails.prepare(all? "DELETE FROM MediaThumbnails" : "DELETE FROM MediaThumbnails WHERE peer = :peer");
+
+    QSqlQuery insert(db);
+    insert.prepare("INSERT OR REPLACE INTO DownloadedMedia (peer, media, path) VALUES (:peer, :media, :path)");
+    QSqlQuery insertThumbnail(db);
+    insertThumbnail.prepare("INSERT OR REPLACE INTO MediaThumbnails (peer, media, path) VALUES (:peer, :media, :path)");
+
+    db.transaction();
+    if(all && (!remove.exec() || !removeThumbnails.exec()))
+    {
+        qCritical() << TAG << "could not index downloads:" << remove.lastError().text() << removeThumbnails.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    int count = 0;
+    int thumbnailCount = 0;
+    for(int i = 0; i < peerIds.count(); i++)
+    {
+        const qint64 peer = peerIds.at(i);
+        if(!all)
+        {
+            remove.bindValue(":peer", peer);
+            removeThumbnails.bindValue(":peer", peer);
+            if(!remove.exec() || !removeThumbnails.exec())
+            {
+                qCritical() << TAG << "could not index downloads:" << remove.lastError().text() << removeThumbnails.lastError().text();
+                db.rollback();
+                return false;
+            }
+        }
+
+        for(int j = 0; j < media.at(i).count(); j++)
+        {
+            insert.bindValue(":peer", peer);
+            insert.bindValue(":media", media.at(i).at(j));
+            insert.bindValue(":path", paths.at(i).at(j));
+            if(!insert.exec())
+            {
+                qCritical() << TAG << "could not index downloads:" << insert.lastError().text();
+                db.rollback();
+                return false;
+            }
+            count++;
+        }
+
+        for(int j = 0; j < thumbnailMedia.at(i).count(); j++)
+        {
+            insertThumbnail.bindValue(":peer", peer);
+            insertThumbnail.bindValue(":media", thumbnailMedia.at(i).at(j));
+            insertThumbnail.bindValue(":path", thumbnailPaths.at(i).at(j));
+            if(!insertThumbnail.exec())
+            {
+                qCritical() << TAG << "could not index downloads:" << insertThumbnail.lastError().text();
+                db.rollback();
+                return false;
+            }
+            thumbnailCount++;
+        }
+    }
+
+    if(!db.commit())
+    {
+        qCritical() << TAG << "could not index downloads:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    qDebug() << TAG << "indexed" << count << "downloads and" << thumbnailCount << "thumbnails in" << dirs.count() << "peers in" << timer.elapsed() << "ms";
+    return true;
+}
+
+QString ScopeIndexerCore::writeThumbnail(const QFileInfo &photo, const QString &thumbnailPath)
+{
+    QImageReader reader(photo.absoluteFilePath());
+    const QSize &size = reader.size();
+    if(!size.isValid())
+        return QString();
+
+    // Photos no bigger than a card are shown as they are.
+    if(size.width() <= THUMBNAIL_SIZE || size.height() <= THUMBNAIL_SIZE)
+        return photo.absoluteFilePath();
+
+    // Kept until the photo is replaced.
+    const QFileInfo thumbnail(thumbnailPath);
+    if(thumbnail.exists() && thumbnail.lastModified() >= photo.lastModified())
+        return thumbnailPath;
+
+    // Cards are cropped square, so the short side is the one that has to
+    // fill the card. The JPEG decoder scales while decoding.
+    reader.setScaledSize(size.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatioByExpanding));
+    const QImage &image = reader.read();
+    if(image.isNull())
+    {
+        qWarning() << TAG << "could not read" << photo.absoluteFilePath() << reader.errorString();
+        return QString();
+    }
+
+    QSaveFile file(thumbnailPath);
+    if(!file.open(QIODevice::WriteOnly) || !image.save(&file, "JPEG", THUMBNAIL_QUALITY) || !file.commit())
+    {
+        qWarning() << TAG << "could not write" << thumbnailPath << file.errorString();
+        return QString();
+    }
+
+    return thumbnailPath;
+}
+
+ScopeIndexerCore::~ScopeIndexerCore()
+{
+    if(db.isValid())
+    {
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+}
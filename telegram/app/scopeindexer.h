@@ -0,0 +1,117 @@
+#ifndef SCOPEINDEXER_H
+#define SCOPEINDEXER_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QVariantList>
+#include <QVariantMap>
+
+// Maintains the derived tables, indexes and triggers the scope reads from
+// an account's database.db. The database itself is owned by TelegramQML, so
+// everything added here must be optional for the scope and must never get in
+// the way of TelegramQML's own writes.
+//
+// It also rewrites the surfacing snapshot (see shared/surfacingsnapshot.h)
+// a moment after the database settles, so the scope can show unread chats,
+// recent chats and photos without opening it, and keeps the DownloadedMedia
+// table in step with the account's downloads directory, so the scope can tell
+// downloaded media apart without a stat() per card. Names and avatars of
+// dialog peers go to the peer hints file the push helper reads (see
+// shared/peerhints.h), and the chats it showed notifications for come back
+// through prefetch(), which reads their latest messages ahead of the tap.
+
+class QFileInfo;
+class TelegramQml;
+class ScopeIndexerPrivate;
+class ScopeIndexer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(TelegramQml* telegram READ telegram WRITE setTelegram NOTIFY telegramChanged)
+    Q_PROPERTY(bool ready READ ready NOTIFY readyChanged)
+
+public:
+    ScopeIndexer(QObject *parent = 0);
+    ~ScopeIndexer();
+
+    void setTelegram(TelegramQml *tg);
+    TelegramQml *telegram() const;
+
+    bool ready() const;
+
+    // Peers from Cutegram.takePrefetchSpool(), those of other accounts are
+    // skipped. Kept until the database is known.
+    Q_INVOKABLE void prefetch(const QVariantList &peers);
+
+signals:
+    void telegramChanged();
+    void readyChanged();
+    // peer, chat and photos: ids of the peer's latest photo messages
+    // that are not downloaded yet.
+    void prefetched(const QVariantMap &peer);
+
+private slots:
+    void recheck();
+    void upgraded(const QString &databasePath, int version);
+    void upgradeTimeout();
+    void corePrefetched(const QString &databasePath, const QVariantMap &peer);
+    void databaseChanged(const QString &path);
+    void snapshotTimeout();
+    void downloadsChanged(const QString &path);
+    void downloadsTimeout();
+
+private:
+    void watchDownloads();
+
+    ScopeIndexerPrivate *p;
+};
+
+class ScopeIndexerCore : public QObject
+{
+    Q_OBJECT
+
+public:
+    ScopeIndexerCore(QObject *parent = 0);
+    ~ScopeIndexerCore();
+
+public slots:
+    void upgrade(const QString &databasePath, const QString &downloadsPath);
+    void writeSnapshot(const QString &databasePath);
+    void syncDownloads(const QString &databasePath, const QString &downloadsPath, const QStringList &peers);
+    void updatePeerSearch(const QString &databasePath);
+    void writePeerHints(const QString &databasePath);
+    void prefetch(const QString &databasePath, const QVariantList &peers);
+
+signals:
+    void upgraded(const QString &databasePath, int version);
+    void prefetched(const QString &databasePath, const QVariantMap &peer);
+
+private:
+    bool open(const QString &databasePath);
+    int version();
+    bool setVersion(int version);
+    QStringList migration(int version);
+    bool backfill(int version);
+    bool backfillMessageIndex();
+    bool indexPendingPeers();
+    bool indexDownloads(const QString &downloadsPath, const QStringList &peers);
+    QString writeThumbnail(const QFileInfo &photo, const QString &thumbnailPath);
+    int readSnapshotEntries(QSqlQuery &query, QByteArray &entries, QByteArray &strings);
+
+private:
+    const QString TAG = "ScopeIndexer:";
+    const int BACKFILL_BATCH = 2000;
+    const int SNAPSHOT_DIALOGS = 20;
+    const int SNAPSHOT_PHOTOS = 30;
+    const int RECENT_MEDIA = 300;
+    const int PREFETCH_MESSAGES = 50;
+    const int THUMBNAIL_SIZE = 256;
+    const int THUMBNAIL_QUALITY = 85;
+
+    const QString connectionName;
+    QSqlDatabase db;
+    QString downloadsPath;
+    QStringList peerHints;
+};
+
+#endif // SCOPEINDEXER_H
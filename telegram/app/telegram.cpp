@@ -28,11 +28,16 @@
 #include "asemantools/asemanapplication.h"
 #include "emoticonsmodel.h"
 #include "stickerfilemanager.h"
+#include "scopeindexer.h"
 #include "themeitem.h"
 #include "textemojiwrapper.h"
 #include "emojis.h"
+#include "emojiimageprovider.h"
+#include "emojitheme.h"
 #include "unitysystemtray.h"
 #include "cutegramenums.h"
+#include "accountpaths.h"
+#include "prefetchspool.h"
 #include <userdata.h>
 
 #include <QPointer>
@@ -189,6 +194,7 @@ Cutegram::Cutegram(QObject *parent) :
     qmlRegisterType<Emojis>("Cutegram", 1, 0, "Emojis");
     qmlRegisterType<EmoticonsModel>("Cutegram", 1, 0, "EmoticonsModel");
     qmlRegisterType<StickerFileManager>("Cutegram", 1, 0, "StickerFileManager");
+    qmlRegisterType<ScopeIndexer>("Cutegram", 1, 0, "ScopeIndexer");
 
     init_languages();
 }
@@ -405,6 +411,8 @@ void Cutegram::start(bool forceVisible)
 
     p->viewer = new AsemanQuickView( AsemanQuickView::AllExceptLogger );
     p->viewer->engine()->rootContext()->setContextProperty( "Cutegram", this );
+    EmojiTheme::setCacheDirectory(cacheDirectory() + "/emojis");
+    p->viewer->engine()->addImageProvider( "emoji", new EmojiImageProvider(cacheDirectory() + "/emojis") );
     init_theme();
 
 
@@ -1033,8 +1041,7 @@ QString Cutegram::personalStickerDirectory() const
 
 bool Cutegram::isLoggedIn(const QString &phone) const
 {
-    const QString &ppath = configDirectory() + "/" + phone;
-    return QFile::exists(ppath + "/auth");
+    return QFile::exists(AccountPaths::accountPath(phone, configDirectory()) + "/auth");
 }
 
 QString Cutegram::normalizeText(const QString &text) const
@@ -1045,6 +1052,23 @@ QString Cutegram::normalizeText(const QString &text) const
     return text[0].toUpper() + text.mid(1);
 }
 
+QVariantList Cutegram::takePrefetchSpool()
+{
+    // Chats the push helper showed notifications for since the last call,
+    // see shared/prefetchspool.h.
+    QVariantList result;
+    const QString &path = cacheDirectory() + "/" + PrefetchSpool::SPOOL_FILE_NAME;
+    foreach(const PrefetchSpool::Record &record, PrefetchSpool::take(path, QDateTime::currentDateTime().toTime_t()))
+    {
+        QVariantMap map;
+        map["account"] = record.account;
+        map["peer"] = record.peerId;
+        map["chat"] = record.chat;
+        result << map;
+    }
+    return result;
+}
+
 void Cutegram::init_languages()
 {
     // We're using .po 
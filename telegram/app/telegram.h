@@ -209,6 +209,7 @@ public:
 
     Q_INVOKABLE bool isLoggedIn(const QString &phone) const;
     Q_INVOKABLE QString normalizeText(const QString &text) const;
+    Q_INVOKABLE QVariantList takePrefetchSpool();
 
 public slots:
     void start(bool forceVisible = false);
@@ -1,6 +1,5 @@
 #include "textemojiwrapper.h"
 #include "emojis.h"
-#include "asemantools/asemandevices.h"
 
 #include <QPointer>
 #include <QTextDocument>
@@ -83,17 +82,16 @@ void TextEmojiWrapper::refresh()
     cursor.setPosition(0);
 
     QString &text = p->text;
-    const QHash<QString,QString> &emojis = p->emojis->emojis();
     for( int i=0; i<text.size(); i++ )
     {
         QString image;
         for( int j=1; j<5; j++ )
         {
             QString emoji = text.mid(i,j);
-            if( !emojis.contains(emoji) )
+            image = p->emojis->sourceOf(emoji);
+            if( image.isEmpty() )
                 continue;
 
-            image = emojis.value(emoji);
             i += emoji.size()-1;
             break;
         }
@@ -105,7 +103,7 @@ void TextEmojiWrapper::refresh()
         else
         {
             QTextImageFormat format;
-            format.setName(AsemanDevices::localFilesPrePath()+image);
+            format.setName(image);
             format.setHeight(18);
             format.setWidth(18);
 
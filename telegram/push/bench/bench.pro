@@ -0,0 +1,42 @@
+# Standalone benchmark and check of the push helper's conversion of push
+# payloads into postal messages, not part of the click package. Build and
+# run it on the device, in the click chroot or on the desktop:
+#
+#   mkdir build-push-bench && cd build-push-bench && qmake ../bench && make
+#   ./push-bench --help
+
+QT -= gui
+QT += dbus
+CONFIG += console c++11
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = push-bench
+
+# Coalescer state, prefetch spool and peer hints go to this scratch home
+# instead of /home/phablet, see shared/accountpaths.h.
+DEFINES += TELEGRAM_HOME=\\\"/tmp/telegram-push-bench\\\"
+
+INCLUDEPATH += .. ../../shared
+include(../../shared/shared.pri)
+
+MOC_DIR = mocs
+OBJECTS_DIR = objs
+
+SOURCES += \
+    main.cpp \
+    ../coalescer.cpp \
+    ../pushclient.cpp \
+    ../pushformat.cpp \
+    ../pushhelper.cpp
+
+HEADERS += \
+    ../../shared/benchoptions.h \
+    ../config.h \
+    ../coalescer.h \
+    ../i18n.h \
+    ../pushclient.h \
+    ../pushformat.h \
+    ../pushhelper.h \
+    ../pushtrace.h \
+    ../../shared/peerhints.h \
+    ../../shared/prefetchspool.h
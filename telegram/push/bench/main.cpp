@@ -0,0 +1,260 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <algorithm>
+#include <clocale>
+#include <cstdio>
+#include <vector>
+
+#include "benchoptions.h"
+#include "config.h"
+#include "prefetchspool.h"
+#include "pushhelper.h"
+
+// Turns push payloads into postal messages the way the helper does, through
+// PushHelper::pushToPostalMessage(), and prints the cost per payload. Each
+// payload that comes with the postal message it should turn into is checked
+// against it; the exit status is the number of mismatches. Without --dir a
+// built-in set covering every key is used, with --dir the *.json payloads
+// recorded in a directory, each next to an optional *.expected.json holding
+// the whole postal message, {} for payloads the helper should drop.
+//
+// The coalescer state and the prefetch spool live in the scratch home the
+// bench is built for, see bench.pro, and are cleared before each payload.
+
+struct Sample {
+    QString name;
+    QJsonObject push;
+    bool checked;
+    int earlier;            // pushes of the same payload just before it, a burst
+    QJsonObject expected;
+};
+
+class BenchHelper : public PushHelper {
+public:
+    BenchHelper() : PushHelper("com.ubuntu.telegram_telegram", QString(), QString()) {} // no-i18n
+
+    using PushHelper::pushToPostalMessage;
+};
+
+static const char *USAGE =
+    "Usage: push-bench [options]\n"
+    "  --dir PATH       recorded payloads, *.json (built-in samples)\n"
+    "  --runs N         timed runs per payload (1000)\n";
+
+static QJsonObject payload(const QString &key, const QStringList &args, const char *peerKey = 0, const char *peerId = 0) {
+    QJsonObject message;
+    message["loc_key"] = key;
+    message["loc_args"] = QJsonArray::fromStringList(args);
+    if (peerKey) {
+        QJsonObject custom;
+        custom[peerKey] = peerId;
+        message["custom"] = custom;
+    }
+    QJsonObject push;
+    push["message"] = message;
+    return push;
+}
+
+static QJsonObject userPayload(const QString &key, const QStringList &args) {
+    return payload(key, args, "from_id", "42");
+}
+
+static QJsonObject chatPayload(const QString &key, const QStringList &args) {
+    return payload(key, args, "chat_id", "7");
+}
+
+// As PushHelper::pushToPostalMessage() builds it, without an avatar.
+static QJsonObject postal(const QString &tag, const QString &summary, const QString &body,
+                          int count = 0, bool alert = true) {
+    QJsonObject card;
+    card["icon"] = QString();
+    card["summary"] = summary;
+    card["body"] = body;
+    card["actions"] = QJsonArray() << QString("telegram://chat/%1").arg(tag.toLongLong());
+    card["popup"] = alert;
+    card["persist"] = true;
+
+    QJsonObject emblem;
+    emblem["count"] = count;
+    emblem["visible"] = count > 0;
+
+    QJsonObject notification;
+    notification["tag"] = tag;
+    notification["card"] = card;
+    notification["emblem-counter"] = emblem;
+    notification["sound"] = alert;
+    notification["vibrate"] = alert;
+
+    QJsonObject message;
+    message["notification"] = notification;
+    return message;
+}
+
+static std::vector<Sample> builtInSamples() {
+    // Untranslated, the bench resets the locale the helper sets.
+    const QStringList user = QStringList() << "Alice" << "hi";
+    const QStringList chat = QStringList() << "Alice" << "Friends" << "Bob";
+    const QStringList none;
+
+    QJsonObject badge = userPayload("MESSAGE_TEXT", user);
+    QJsonObject badgeMessage = badge["message"].toObject();
+    badgeMessage["badge"] = 3;
+    badge["message"] = badgeMessage;
+
+    QJsonObject legacy = userPayload("MESSAGE_TEXT", user);
+    QJsonObject emblem;
+    emblem["count"] = 5;
+    QJsonObject notification;
+    notification["emblem-counter"] = emblem;
+    legacy["notification"] = notification;
+
+    std::vector<Sample> samples = {
+        { "MESSAGE_TEXT", userPayload("MESSAGE_TEXT", user), true, 0, postal("42", "Alice", "hi") },
+        { "MESSAGE_NOTEXT", userPayload("MESSAGE_NOTEXT", user), true, 0, postal("42", "Alice", "sent you a message") },
+        { "MESSAGE_PHOTO", userPayload("MESSAGE_PHOTO", user), true, 0, postal("42", "Alice", "sent you a photo") },
+        { "MESSAGE_VIDEO", userPayload("MESSAGE_VIDEO", user), true, 0, postal("42", "Alice", "sent you a video") },
+        { "MESSAGE_DOC", userPayload("MESSAGE_DOC", user), true, 0, postal("42", "Alice", "sent you a document") },
+        { "MESSAGE_AUDIO", userPayload("MESSAGE_AUDIO", user), true, 0, postal("42", "Alice", "sent you a voice message") },
+        { "MESSAGE_CONTACT", userPayload("MESSAGE_CONTACT", user), true, 0, postal("42", "Alice", "shared a contact with you") },
+        { "MESSAGE_GEO", userPayload("MESSAGE_GEO", user), true, 0, postal("42", "Alice", "sent you a map") },
+        { "CHAT_MESSAGE_TEXT", chatPayload("CHAT_MESSAGE_TEXT", chat), true, 0, postal("7", "Friends", "Alice: Bob") },
+        { "CHAT_MESSAGE_NOTEXT", chatPayload("CHAT_MESSAGE_NOTEXT", chat), true, 0, postal("7", "Friends", "Alice sent a message to the group") },
+        { "CHAT_MESSAGE_PHOTO", chatPayload("CHAT_MESSAGE_PHOTO", chat), true, 0, postal("7", "Friends", "Alice sent a photo to the group") },
+        { "CHAT_MESSAGE_VIDEO", chatPayload("CHAT_MESSAGE_VIDEO", chat), true, 0, postal("7", "Friends", "Alice sent a video to the group") },
+        { "CHAT_MESSAGE_DOC", chatPayload("CHAT_MESSAGE_DOC", chat), true, 0, postal("7", "Friends", "Alice sent a document to the group") },
+        { "CHAT_MESSAGE_AUDIO", chatPayload("CHAT_MESSAGE_AUDIO", chat), true, 0, postal("7", "Friends", "Alice sent a voice message to the group") },
+        { "CHAT_MESSAGE_CONTACT", chatPayload("CHAT_MESSAGE_CONTACT", chat), true, 0, postal("7", "Friends", "Alice sent a contact to the group") },
+        { "CHAT_MESSAGE_GEO", chatPayload("CHAT_MESSAGE_GEO", chat), true, 0, postal("7", "Friends", "Alice sent a map to the group") },
+        { "CHAT_CREATED", chatPayload("CHAT_CREATED", chat), true, 0, postal("7", "Friends", "Alice invited you to the group") },
+        { "CHAT_TITLE_EDITED", chatPayload("CHAT_TITLE_EDITED", chat), true, 0, postal("7", "Friends", "Alice changed group name") },
+        { "CHAT_PHOTO_EDITED", chatPayload("CHAT_PHOTO_EDITED", chat), true, 0, postal("7", "Friends", "Alice changed group photo") },
+        { "CHAT_ADD_MEMBER", chatPayload("CHAT_ADD_MEMBER", chat), true, 0, postal("7", "Friends", "Alice invited Bob") },
+        { "CHAT_ADD_YOU", chatPayload("CHAT_ADD_YOU", chat), true, 0, postal("7", "Friends", "Alice invited you to the group") },
+        { "CHAT_DELETE_MEMBER", chatPayload("CHAT_DELETE_MEMBER", chat), true, 0, postal("7", "Friends", "Alice removed Bob") },
+        { "CHAT_DELETE_YOU", chatPayload("CHAT_DELETE_YOU", chat), true, 0, postal("7", "Friends", "Alice removed you from the group") },
+        { "CHAT_LEFT", chatPayload("CHAT_LEFT", chat), true, 0, postal("7", "Friends", "Alice has left the group") },
+        { "CHAT_RETURNED", chatPayload("CHAT_RETURNED", chat), true, 0, postal("7", "Friends", "Alice has returned to the group") },
+        { "GEOCHAT_CHECKIN", chatPayload("GEOCHAT_CHECKIN", chat), true, 0, postal("7", "@ Friends", "Alice has checked-in") },
+        { "CONTACT_JOINED", userPayload("CONTACT_JOINED", user), true, 0, postal("42", "Telegram", "Alice joined Telegram!") },
+        { "AUTH_UNKNOWN", userPayload("AUTH_UNKNOWN", user), true, 0, postal("42", "Alice", "New login from unrecognized device") },
+        { "AUTH_REGION", userPayload("AUTH_REGION", user), true, 0, postal("42", "Alice @ hi", "New login from unrecognized device") },
+        { "CONTACT_PHOTO", userPayload("CONTACT_PHOTO", user), true, 0, postal("42", "Alice", "updated profile photo") },
+        { "ENCRYPTION_REQUEST", payload("ENCRYPTION_REQUEST", none), true, 0, postal("", "Telegram", "You have a new message") },
+        { "ENCRYPTION_ACCEPT", payload("ENCRYPTION_ACCEPT", none), true, 0, postal("", "Telegram", "You have a new message") },
+        { "ENCRYPTED_MESSAGE", payload("ENCRYPTED_MESSAGE", none), true, 0, postal("", "Telegram", "You have a new message") },
+        // Arguments the server left out are empty, not read past the end.
+        { "missing args", chatPayload("CHAT_ADD_MEMBER", QStringList() << "Alice"), true, 0, postal("7", "", "Alice invited ") },
+        // A name is inserted as it is, its own markers are not expanded.
+        { "marker in name", chatPayload("CHAT_ADD_MEMBER", QStringList() << "Alice %2" << "Friends" << "Bob"), true, 0,
+          postal("7", "Friends", "Alice %2 invited Bob") },
+        { "badge", badge, true, 0, postal("42", "Alice", "hi", 3) },
+        { "legacy count", legacy, true, 0, postal("42", "Alice", "hi", 5) },
+        { "burst", userPayload("MESSAGE_TEXT", user), true, 1, postal("42", "Alice", "2 new messages\nhi", 0, false) },
+        { "unknown key", userPayload("PINNED_TEXT", user), true, 0, QJsonObject() },
+    };
+    return samples;
+}
+
+static std::vector<Sample> recordedSamples(const QString &path) {
+    std::vector<Sample> samples;
+    QDir dir(path);
+    const QStringList files = dir.entryList(QStringList() << "*.json", QDir::Files, QDir::Name);
+    for (const QString &file: files) {
+        if (file.endsWith(".expected.json")) continue;
+
+        QFile in(dir.filePath(file));
+        if (!in.open(QIODevice::ReadOnly)) continue;
+        Sample sample = { file, QJsonDocument::fromJson(in.readAll()).object(), false, 0, QJsonObject() };
+
+        QFile expected(dir.filePath(file.left(file.size() - 5) + ".expected.json"));
+        if (expected.open(QIODevice::ReadOnly)) {
+            sample.checked = true;
+            sample.expected = QJsonDocument::fromJson(expected.readAll()).object();
+        }
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString dir;
+    int runs = 1000;
+
+    const int status = BenchOptions::parse(app.arguments(), USAGE, QStringList(),
+                                           [&](QString const &arg, QString const &value) -> bool {
+        if (arg == "--dir") dir = value;
+        else if (arg == "--runs") runs = qMax(1, value.toInt());
+        else return false;
+        return true;
+    });
+    if (status >= 0) {
+        return status;
+    }
+
+    const std::vector<Sample> samples = dir.isEmpty() ? builtInSamples() : recordedSamples(dir);
+    if (samples.empty()) {
+        fprintf(stderr, "No payloads in %s\n", qPrintable(dir));
+        return 1;
+    }
+
+    QDir().mkpath(CONFIG_PATH);
+    QDir().mkpath(CACHE_PATH);
+    BenchHelper helper;
+    setlocale(LC_ALL, "C");
+
+    int mismatches = 0;
+    printf("%-24s %8s %8s %s\n", "payload", "p50 us", "p95 us", "check");
+    for (auto &sample: samples) {
+        QFile::remove(COALESCE_STATE_PATH);
+        QFile::remove(CACHE_PATH + "/" + PrefetchSpool::SPOOL_FILE_NAME);
+
+        QString tag;
+        for (int i = 0; i < sample.earlier; i++) {
+            helper.pushToPostalMessage(sample.push, tag);
+        }
+
+        // The first one is checked, the others time the helper with the
+        // burst the first one started.
+        QJsonObject postalMessage;
+        std::vector<qint64> elapsed;
+        for (int run = 0; run <= runs; run++) {
+            QElapsedTimer timer;
+            timer.start();
+            const QJsonObject converted = helper.pushToPostalMessage(sample.push, tag);
+            const qint64 nsecs = timer.nsecsElapsed();
+            if (run == 0) {
+                postalMessage = converted;
+                continue;
+            }
+            elapsed.push_back(nsecs);
+        }
+
+        const char *check = "-";
+        if (sample.checked) {
+            const bool ok = postalMessage == sample.expected;
+            check = ok ? "ok" : "MISMATCH";
+            if (!ok) {
+                mismatches++;
+            }
+        }
+
+        std::sort(elapsed.begin(), elapsed.end());
+        printf("%-24s %8.2f %8.2f %s\n", qPrintable(sample.name),
+               BenchOptions::percentile(elapsed, 0.50, 1e3), BenchOptions::percentile(elapsed, 0.95, 1e3), check);
+        if (sample.checked && postalMessage != sample.expected) {
+            printf("    got      %s\n", QJsonDocument(postalMessage).toJson(QJsonDocument::Compact).constData());
+            printf("    expected %s\n", QJsonDocument(sample.expected).toJson(QJsonDocument::Compact).constData());
+        }
+    }
+
+    return mismatches;
+}
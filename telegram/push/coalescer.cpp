@@ -0,0 +1,69 @@
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSettings>
+
+#include "coalescer.h"
+#include "config.h"
+
+Coalescer::Coalescer(const QString &statePath, const QString &settingsPath)
+        : mStatePath(statePath), mLock(statePath + ".lock") { // no-i18n
+    // Without the lock the pushes of another helper would be lost; if it
+    // does not come in time this one goes on rather than dropping its own.
+    if (!mLock.tryLock(COALESCE_LOCK_TIMEOUT_MSECS)) {
+        qWarning() << "Could not lock push state:" << mLock.error(); // no-i18n
+    }
+
+    QSettings settings(settingsPath, QSettings::IniFormat);
+    mWindow = settings.value("Push/coalesceWindow", COALESCE_WINDOW_SECS).toInt(); // no-i18n
+    mAlertInterval = settings.value("Push/alertInterval", ALERT_INTERVAL_SECS).toInt(); // no-i18n
+    mMaxAlertsPerMinute = settings.value("Push/maxAlertsPerMinute", MAX_ALERTS_PER_MINUTE).toInt(); // no-i18n
+
+    QFile file(mStatePath);
+    if (file.open(QIODevice::ReadOnly)) {
+        mState = QJsonDocument::fromJson(file.readAll()).object();
+    }
+}
+
+Coalescer::Burst Coalescer::add(const QString &tag, qint64 now) {
+    // Doubles in JSON hold seconds since epoch exactly.
+    QJsonObject chats = mState["chats"].toObject(); // no-i18n
+    QJsonArray alerts;
+    for (const QJsonValue &alert: mState["alerts"].toArray()) { // no-i18n
+        if (now - qint64(alert.toDouble()) < 60) alerts.append(alert);
+    }
+    for (const QString &key: chats.keys()) {
+        if (now - qint64(chats[key].toObject()["last"].toDouble()) > mWindow) chats.remove(key); // no-i18n
+    }
+
+    QJsonObject chat = chats[tag].toObject();
+    Burst burst;
+    burst.count = chat["count"].toInt() + 1; // no-i18n
+    const qint64 alerted = qint64(chat["alerted"].toDouble()); // no-i18n
+    burst.alert = (alerted == 0 || now - alerted >= mAlertInterval) && alerts.size() < mMaxAlertsPerMinute;
+
+    chat["count"] = burst.count; // no-i18n
+    chat["last"] = double(now); // no-i18n
+    if (burst.alert) {
+        chat["alerted"] = double(now); // no-i18n
+        alerts.append(double(now));
+    }
+    chats[tag] = chat;
+
+    mState["chats"] = chats; // no-i18n
+    mState["alerts"] = alerts; // no-i18n
+    return burst;
+}
+
+bool Coalescer::save() {
+    QSaveFile file(mStatePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Could not write push state:" << file.errorString(); // no-i18n
+        return false;
+    }
+    file.write(QJsonDocument(mState).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
@@ -0,0 +1,40 @@
+#ifndef COALESCER_H
+#define COALESCER_H
+
+#include <QJsonObject>
+#include <QLockFile>
+#include <QString>
+
+// Keeps what the last pushes of each chat looked like across helper runs, so
+// that a burst in one chat turns into one card with a count rather than a
+// popup, sound and vibration per message. The state is a small JSON file in
+// the app's cache directory; entries older than the window are dropped on
+// every run. Helpers run side by side during a burst, so a Coalescer holds
+// a lock on the state from construction until it is destroyed.
+
+class Coalescer {
+public:
+    struct Burst {
+        int count;      // pushes of the chat in the current burst, this one included
+        bool alert;     // whether this one may pop up, sound and vibrate
+    };
+
+    Coalescer(const QString &statePath, const QString &settingsPath);
+
+    // Records a push for tag at now, in seconds since epoch.
+    Burst add(const QString &tag, qint64 now);
+
+    // Writes the state back, false if it could not.
+    bool save();
+
+private:
+    QString mStatePath;
+    QLockFile mLock;
+    QJsonObject mState;
+
+    int mWindow;
+    int mAlertInterval;
+    int mMaxAlertsPerMinute;
+};
+
+#endif
@@ -1,15 +1,27 @@
 #pragma once
 
-// TODO This is shared with scope and should be put to a shared class.
-
+#include "accountpaths.h"
 #include "i18n.h"
 
 const bool DEBUG = false;
 
-const QString CONFIG_PATH       = "/home/phablet/.config/com.ubuntu.telegram";
-const QString CACHE_PATH        = "/home/phablet/.cache/com.ubuntu.telegram";
-const QString PROFILES_PATH     = CONFIG_PATH + "/profiles.sqlite";
-const QString DATABASE_PATH_FMT = CONFIG_PATH + "/%1/database.db";
+const QString CONFIG_PATH       = AccountPaths::configPath();
+const QString CACHE_PATH        = AccountPaths::cachePath();
+
+// The push client shows nothing until the helper has exited, so its whole
+// run is traced and reported when it takes longer than this.
+const int PUSH_BUDGET_MS    = 100;
+// How long to wait for Postal to clear an earlier notification of the chat.
+const int DBUS_TIMEOUT_MS   = 1000;
 
-const QString PROFILE_DIR_FMT   = CACHE_PATH + "/%1/downloads/%2/profile";
-const QString PROFILE_FILE_FMT  = "file://" + CACHE_PATH + "/%1/downloads/%2/profile/%3";
\ No newline at end of file
+// Coalescing of pushes per chat, see coalescer.h. Defaults of the [Push]
+// keys in the app's config.ini: pushes of a chat less than coalesceWindow
+// seconds apart update one card, which alerts at most every alertInterval
+// seconds, and all chats together alert at most maxAlertsPerMinute times.
+const QString COALESCE_STATE_PATH   = CACHE_PATH + "/push.state";
+const QString PUSH_SETTINGS_PATH    = CONFIG_PATH + "/config.ini";
+const int COALESCE_WINDOW_SECS      = 120;
+const int ALERT_INTERVAL_SECS       = 30;
+const int MAX_ALERTS_PER_MINUTE     = 6;
+// How long a helper waits for another one to finish with the state.
+const int COALESCE_LOCK_TIMEOUT_MSECS = 2000;
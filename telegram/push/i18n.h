@@ -8,3 +8,6 @@ const QString GETTEXT_DOMAIN   = "com.ubuntu.telegram";
 
 #define _(value) gettext(value)
 #define N_(value) gettext(value)
+// Marks a string for translation where it cannot be translated yet, e.g. in
+// a static table; gettext() it where it is used.
+#define NOOP_(value) value
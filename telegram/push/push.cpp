@@ -1,10 +1,12 @@
 #include <QCoreApplication>
 #include <QStringList>
-#include <QTimer>
 
 #include "pushhelper.h"
+#include "pushtrace.h"
 
 int main(int argc, char *argv[]) {
+    PushTrace::start();
+
     if (argc != 3) {
         qFatal("Usage: %s infile outfile", argv[0]); // no-i18n
     }
@@ -14,12 +16,14 @@ int main(int argc, char *argv[]) {
 
     PushHelper pushHelper("com.ubuntu.telegram_telegram", // no-i18n
                           QString(args.at(1)), QString(args.at(2)), &app);
+    PushTrace::mark("app"); // no-i18n
 
-    QObject::connect(&pushHelper, SIGNAL(done()), &app, SLOT(quit()));
+    // process() may be done before the event loop runs, a direct quit() would
+    // be lost then.
+    QObject::connect(&pushHelper, SIGNAL(done()), &app, SLOT(quit()), Qt::QueuedConnection);
     pushHelper.process();
 
-    // TODO check why I need this and the connect above doesn't work.
-    QTimer::singleShot(500, &app, SLOT(quit()));
-
-    return app.exec();
+    const int result = app.exec();
+    PushTrace::report();
+    return result;
 }
@@ -1,16 +1,18 @@
 TEMPLATE = app
 TARGET = push
 QT -= gui
-QT += sql dbus widgets
-INCLUDEPATH += .
+QT += dbus
+CONFIG += c++11
+INCLUDEPATH += . ../shared
+include(../shared/shared.pri)
 
 MOC_DIR = mocs
 OBJECTS_DIR = objs
 
 #load(ubuntu-click)
 
-HEADERS += pushclient.h pushhelper.h
-SOURCES += push.cpp pushclient.cpp pushhelper.cpp
+HEADERS += coalescer.h pushclient.h pushformat.h pushhelper.h pushtrace.h ../shared/peerhints.h ../shared/prefetchspool.h
+SOURCES += coalescer.cpp push.cpp pushclient.cpp pushformat.cpp pushhelper.cpp
 OTHER += apparmor-push.json push-helper.json
 
 other.files += $$OTHER
@@ -15,6 +15,7 @@ License along with this program.  If not, see
 <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
 #include "pushclient.h"
 #include <QtDBus/QDBusConnection>
 #include <QtDBus/QDBusMessage>
@@ -60,9 +61,8 @@ void PushClient::clearPersistent(const QStringList &tags) {
     for (int i = 0; i < tags.size(); ++i) {
 		message << tags.at(i);
 	}
-    bus.send(message);
 
-    QDBusPendingCall pcall = bus.asyncCall(message);
+    QDBusPendingCall pcall = bus.asyncCall(message, DBUS_TIMEOUT_MS);
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(pcall, this);
     connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
                   this, SLOT(clearPersistentFinished(QDBusPendingCallWatcher*)));
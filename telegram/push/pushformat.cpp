@@ -0,0 +1,111 @@
+#include <cstring>
+
+#include "i18n.h"
+#include "pushformat.h"
+
+namespace PushFormat {
+
+#define LOC_KEY(key, summary, s1, s2, body, b1, b2) { keyHash(key), key, summary, { s1, s2 }, body, { b1, b2 } }
+
+// The first argument is the sender for private messages, the second the
+// group for group messages.
+static constexpr LocKey LOC_KEYS[] = {
+    LOC_KEY("MESSAGE_TEXT", "%1", 0, NO_ARG, "%1", 1, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_NOTEXT", "%1", 0, NO_ARG, NOOP_("sent you a message"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_PHOTO", "%1", 0, NO_ARG, NOOP_("sent you a photo"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_VIDEO", "%1", 0, NO_ARG, NOOP_("sent you a video"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_DOC", "%1", 0, NO_ARG, NOOP_("sent you a document"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_AUDIO", "%1", 0, NO_ARG, NOOP_("sent you a voice message"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_CONTACT", "%1", 0, NO_ARG, NOOP_("shared a contact with you"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("MESSAGE_GEO", "%1", 0, NO_ARG, NOOP_("sent you a map"), NO_ARG, NO_ARG), // no-i18n
+
+    LOC_KEY("CHAT_MESSAGE_TEXT", "%1", 1, NO_ARG, NOOP_("%1: %2"), 0, 2), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_NOTEXT", "%1", 1, NO_ARG, NOOP_("%1 sent a message to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_PHOTO", "%1", 1, NO_ARG, NOOP_("%1 sent a photo to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_VIDEO", "%1", 1, NO_ARG, NOOP_("%1 sent a video to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_DOC", "%1", 1, NO_ARG, NOOP_("%1 sent a document to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_AUDIO", "%1", 1, NO_ARG, NOOP_("%1 sent a voice message to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_CONTACT", "%1", 1, NO_ARG, NOOP_("%1 sent a contact to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_MESSAGE_GEO", "%1", 1, NO_ARG, NOOP_("%1 sent a map to the group"), 0, NO_ARG), // no-i18n
+
+    LOC_KEY("CHAT_CREATED", "%1", 1, NO_ARG, NOOP_("%1 invited you to the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_TITLE_EDITED", "%1", 1, NO_ARG, NOOP_("%1 changed group name"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_PHOTO_EDITED", "%1", 1, NO_ARG, NOOP_("%1 changed group photo"), 0, NO_ARG), // no-i18n
+    // TRANSLATORS: Notification message saying: person A invited person B (to a group)
+    LOC_KEY("CHAT_ADD_MEMBER", "%1", 1, NO_ARG, NOOP_("%1 invited %2"), 0, 2), // no-i18n
+    LOC_KEY("CHAT_ADD_YOU", "%1", 1, NO_ARG, NOOP_("%1 invited you to the group"), 0, NO_ARG), // no-i18n
+    // TRANSLATORS: Notification message saying: person A removed person B (from a group)
+    LOC_KEY("CHAT_DELETE_MEMBER", "%1", 1, NO_ARG, NOOP_("%1 removed %2"), 0, 2), // no-i18n
+    LOC_KEY("CHAT_DELETE_YOU", "%1", 1, NO_ARG, NOOP_("%1 removed you from the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_LEFT", "%1", 1, NO_ARG, NOOP_("%1 has left the group"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CHAT_RETURNED", "%1", 1, NO_ARG, NOOP_("%1 has returned to the group"), 0, NO_ARG), // no-i18n
+
+    LOC_KEY("GEOCHAT_CHECKIN", // no-i18n
+            // TRANSLATORS: This format string tells location, like: @ McDonals, New York
+            NOOP_("@ %1"), 1, NO_ARG,
+            // TRANSLATORS: This format string tells who has checked in (in a geographical location).
+            NOOP_("%1 has checked-in"), 0, NO_ARG), // no-i18n
+    LOC_KEY("CONTACT_JOINED", // no-i18n
+            // TRANSLATORS: Application name.
+            NOOP_("Telegram"), NO_ARG, NO_ARG,
+            // TRANSLATORS: This format string tells who has just joined Telegram.
+            NOOP_("%1 joined Telegram!"), 0, NO_ARG), // no-i18n
+    LOC_KEY("AUTH_UNKNOWN", "%1", 0, NO_ARG, NOOP_("New login from unrecognized device"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("AUTH_REGION", // no-i18n
+            // TRANSLATORS: This format string indicates new login of: (device name) at (location).
+            NOOP_("%1 @ %2"), 0, 1,
+            NOOP_("New login from unrecognized device"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("CONTACT_PHOTO", "%1", 0, NO_ARG, NOOP_("updated profile photo"), NO_ARG, NO_ARG), // no-i18n
+
+    LOC_KEY("ENCRYPTION_REQUEST", NOOP_("Telegram"), NO_ARG, NO_ARG, NOOP_("You have a new message"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("ENCRYPTION_ACCEPT", NOOP_("Telegram"), NO_ARG, NO_ARG, NOOP_("You have a new message"), NO_ARG, NO_ARG), // no-i18n
+    LOC_KEY("ENCRYPTED_MESSAGE", NOOP_("Telegram"), NO_ARG, NO_ARG, NOOP_("You have a new message"), NO_ARG, NO_ARG), // no-i18n
+};
+
+#undef LOC_KEY
+
+static QString formatArgs(const char *format, const qint8 indices[2], const QJsonArray &args) {
+    // "%1" alone is an argument as is, everything else is translated.
+    if (strcmp(format, "%1") == 0) { // no-i18n
+        return indices[0] < args.size() ? args[indices[0]].toString() : QString();
+    }
+
+    auto arg = [&args](qint8 index) {
+        return index < args.size() ? args[index].toString() : QString();
+    };
+
+    // Both arguments go in at once, so that a "%2" in the first, say in a
+    // name, is not taken for a marker.
+    const QString text = QString::fromUtf8(gettext(format));
+    if (indices[0] == NO_ARG) {
+        return text;
+    }
+    if (indices[1] == NO_ARG) {
+        return text.arg(arg(indices[0]));
+    }
+    return text.arg(arg(indices[0]), arg(indices[1]));
+}
+
+const LocKey *find(const QString &key) {
+    const QByteArray latin1 = key.toLatin1();
+    const quint32 hash = keyHash(latin1.constData());
+    for (const LocKey &locKey: LOC_KEYS) {
+        if (locKey.hash == hash && latin1 == locKey.key) {
+            return &locKey;
+        }
+    }
+    return nullptr;
+}
+
+bool format(const QString &key, const QJsonArray &args, QString &summary, QString &body) {
+    const LocKey *locKey = find(key);
+    if (!locKey) {
+        return false;
+    }
+
+    summary = formatArgs(locKey->summary, locKey->summaryArgs, args);
+    body = formatArgs(locKey->body, locKey->bodyArgs, args);
+    return true;
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef PUSH_FORMAT_H
+#define PUSH_FORMAT_H
+
+#include <QJsonArray>
+#include <QString>
+#include <QtGlobal>
+
+// Turns the loc_key and loc_args of a push into the summary and body of its
+// card. Every known key has one descriptor in a table built at compile time:
+// which of the loc_args go into which translatable format. Arguments missing
+// from a push come out empty instead of being read past the end.
+//
+// See: https://core.telegram.org/api/push-updates
+
+namespace PushFormat {
+
+const qint8 NO_ARG = -1;
+
+struct LocKey {
+    quint32 hash;           // keyHash() of key
+    const char *key;
+    const char *summary;    // untranslated format with up to two arguments
+    qint8 summaryArgs[2];   // loc_args index for %1 and %2, or NO_ARG
+    const char *body;
+    qint8 bodyArgs[2];
+};
+
+// FNV-1a, so the table is searched by comparing integers.
+constexpr quint32 keyHash(const char *key, quint32 hash = 2166136261u) {
+    return *key ? keyHash(key + 1, (hash ^ quint8(*key)) * 16777619u) : hash;
+}
+
+// Descriptor of key, null for keys the helper does not know.
+const LocKey *find(const QString &key);
+
+// Fills summary and body for a push, false for an unknown key.
+bool format(const QString &key, const QJsonArray &args, QString &summary, QString &body);
+
+}
+
+#endif
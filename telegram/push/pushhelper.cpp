@@ -1,17 +1,18 @@
-#include <QApplication>
+#include <QDateTime>
 #include <QDebug>
-#include <QDir>
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
-#include <QSqlDatabase>
 #include <QStringList>
-#include <QSqlQuery>
-#include <QSqlRecord>
 #include <QTextStream>
 
+#include "coalescer.h"
 #include "i18n.h"
+#include "peerhints.h"
+#include "prefetchspool.h"
+#include "pushformat.h"
 #include "pushhelper.h"
+#include "pushtrace.h"
 
 PushHelper::PushHelper(QString appId, QString infile, QString outfile,
                        QObject *parent) : QObject(parent) {
@@ -20,6 +21,8 @@ PushHelper::PushHelper(QString appId, QString infile, QString outfile,
 
     connect(&mPushClient, SIGNAL(persistentCleared()),
                     this, SLOT(notificationDismissed()));
+    connect(&mPushClient, SIGNAL(error(QString)),
+                    this, SLOT(notificationDismissed()));
 
     mPushClient.setAppId(appId);
     mPushClient.registerApp(appId);
@@ -34,18 +37,28 @@ void PushHelper::process() {
     QString tag = "";
 
     QJsonObject pushMessage = readPushMessage(mInfile);
-    mPostalMessage = pushToPostalMessage(pushMessage, tag);
-    if (!tag.isEmpty()) {
-        dismissNotification(tag);
+    PushTrace::mark("read"); // no-i18n
+    QJsonObject postalMessage = pushToPostalMessage(pushMessage, tag);
+    PushTrace::mark("convert"); // no-i18n
+
+    // The push client only reads the file after the helper has exited, it
+    // does not have to wait for Postal.
+    writePostalMessage(postalMessage, mOutfile);
+    PushTrace::mark("write"); // no-i18n
+
+    if (tag.isEmpty()) {
+        Q_EMIT done();
+        return;
     }
-    
-    // persistentCleared not called!
-    notificationDismissed();
+
+    // Replaces the chat's earlier notification; done once Postal has
+    // answered, or failed to within DBUS_TIMEOUT_MS.
+    dismissNotification(tag);
 }
 
 void PushHelper::notificationDismissed() {
-    writePostalMessage(mPostalMessage, mOutfile);
-    Q_EMIT done(); // Why does this not work?
+    PushTrace::mark("dismiss"); // no-i18n
+    Q_EMIT done();
 }
 
 QJsonObject PushHelper::readPushMessage(const QString &filename) {
@@ -60,7 +73,10 @@ QJsonObject PushHelper::readPushMessage(const QString &filename) {
 void PushHelper::writePostalMessage(const QJsonObject &postalMessage, const QString &filename) {
     QFile out;
     out.setFileName(filename);
-    out.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) {
+        qCritical() << "Could not write postal message:" << out.errorString(); // no-i18n
+        return;
+    }
 
     QTextStream(&out) << QJsonDocument(postalMessage).toJson();
     out.close();
@@ -92,178 +108,14 @@ QJsonObject PushHelper::pushToPostalMessage(const QJsonObject &push, QString &ta
     if (custom.keys().contains("from_id")) {
         tag = custom["from_id"].toString();
     }
+    bool isChat = false;
     if (custom.keys().contains("chat_id")) {
         tag = custom["chat_id"].toString();
+        isChat = true;
     }
-    qint64 chatId = tag.toInt();
-
-    // TRANSLATORS: Application name.
-    QString tg = QString(N_("Telegram")); // no-i18n
-    summary = args[0].toString();
-
-    if (key == "MESSAGE_TEXT") { // no-i18n
-
-        body = args[1].toString();
-
-    } else if (key == "MESSAGE_NOTEXT") { // no-i18n
-
-        body = N_("sent you a message");
-
-    } else if (key == "MESSAGE_PHOTO") { // no-i18n
-
-        body = N_("sent you a photo");
-
-    } else if (key == "MESSAGE_VIDEO") { // no-i18n
-
-        body = N_("sent you a video");
-
-    } else if (key == "MESSAGE_DOC") { // no-i18n
-
-        body = N_("sent you a document");
-
-    } else if (key == "MESSAGE_AUDIO") { // no-i18n
-
-        body = N_("sent you a voice message");
-
-    } else if (key == "MESSAGE_CONTACT") { // no-i18n
-
-        body = N_("shared a contact with you");
-
-    } else if (key == "MESSAGE_GEO") { // no-i18n
-
-        body = N_("sent you a map");
-
-    } else if (key == "CHAT_MESSAGE_TEXT") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1: %2")).arg(args[0].toString()).arg(args[2].toString()); // no-i18n
-
-    } else if (key == "CHAT_MESSAGE_NOTEXT") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a message to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_MESSAGE_PHOTO") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a photo to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_MESSAGE_VIDEO") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a video to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_MESSAGE_DOC") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a document to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_MESSAGE_AUDIO") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a voice message to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_MESSAGE_CONTACT") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a contact to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_MESSAGE_GEO") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 sent a map to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_CREATED") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 invited you to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_TITLE_EDITED") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 changed group name")).arg(args[0].toString());
-
-    } else if (key == "CHAT_PHOTO_EDITED") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 changed group photo")).arg(args[0].toString());
-
-    } else if (key == "CHAT_ADD_MEMBER") { // no-i18n
+    qint64 chatId = tag.toLongLong();
 
-        summary = args[1].toString();
-        // TRANSLATORS: Notification message saying: person A invited person B (to a group)
-        body = QString(N_("%1 invited %2")).arg(args[0].toString()).arg(args[2].toString());
-
-    } else if (key == "CHAT_ADD_YOU") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 invited you to the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_DELETE_MEMBER") { // no-i18n
-
-        summary = args[1].toString();
-        // TRANSLATORS: Notification message saying: person A removed person B (from a group)
-        body = QString(N_("%1 removed %2")).arg(args[0].toString()).arg(args[2].toString());
-
-    } else if (key == "CHAT_DELETE_YOU") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 removed you from the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_LEFT") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 has left the group")).arg(args[0].toString());
-
-    } else if (key == "CHAT_RETURNED") { // no-i18n
-
-        summary = args[1].toString();
-        body = QString(N_("%1 has returned to the group")).arg(args[0].toString());
-
-    } else if (key == "GEOCHAT_CHECKIN") { // no-i18n
-
-        // TRANSLATORS: This format string tells location, like: @ McDonals, New York
-        summary = QString(N_("@ %1")).arg(args[1].toString());
-        // TRANSLATORS: This format string tells who has checked in (in a geographical location).
-        body = QString(N_("%1 has checked-in")).arg(args[0].toString());
-
-    } else if (key == "CONTACT_JOINED") { // no-i18n
-
-        summary = tg;
-        // TRANSLATORS: This format string tells who has just joined Telegram.
-        body = QString(N_("%1 joined Telegram!")).arg(args[0].toString());
-
-    } else if (key == "AUTH_UNKNOWN") { // no-i18n
-
-        summary = args[0].toString();
-        body = N_("New login from unrecognized device");
-
-    } else if (key == "AUTH_REGION") { // no-i18n
-
-        // TRANSLATORS: This format string indicates new login of: (device name) at (location).
-        summary = QString(N_("%1 @ %2")).arg(args[0].toString()).arg(args[1].toString());
-        body = N_("New login from unrecognized device");
-
-    } else if (key == "CONTACT_PHOTO") { // no-i18n
-
-        body = N_("updated profile photo");
-
-    } else if (key == "ENCRYPTION_REQUEST") { // no-i18n
-
-        summary = tg;
-        body = N_("You have a new message");
-
-    } else if (key == "ENCRYPTION_ACCEPT") { // no-i18n
-
-        summary = tg;
-        body = N_("You have a new message");
-
-    } else if (key == "ENCRYPTED_MESSAGE") { // no-i18n
-
-        summary = tg;
-        body = N_("You have a new message");
-
-    } else {
+    if (!PushFormat::format(key, args, summary, body)) {
         qDebug() << "Unhandled push type: " << key; // no-i18n
         return QJsonObject();
     }
@@ -282,12 +134,42 @@ QJsonObject PushHelper::pushToPostalMessage(const QJsonObject &push, QString &ta
                 .toInt();
     }
 
+    QString account;
+    QString name;
+    QString avatar;
+    if (readPeerHint(chatId, isChat, account, name, avatar) && summary.isEmpty()) {
+        summary = name;
+    }
+
+    // The app warms this chat the next time it comes up, see
+    // shared/prefetchspool.h.
+    if (chatId != 0) {
+        PrefetchSpool::Record record = { account, chatId, isChat, QDateTime::currentDateTime().toTime_t() };
+        PrefetchSpool::append(CACHE_PATH + "/" + PrefetchSpool::SPOOL_FILE_NAME, record);
+    }
+
+    // A burst in one chat keeps updating one card, which only alerts again
+    // after a while.
+    bool alert = true;
+    if (!tag.isEmpty()) {
+        Coalescer coalescer(COALESCE_STATE_PATH, PUSH_SETTINGS_PATH);
+        const Coalescer::Burst burst = coalescer.add(tag, QDateTime::currentDateTime().toTime_t());
+        coalescer.save();
+
+        alert = burst.alert;
+        if (burst.count > 1) {
+            // TRANSLATORS: First line of a notification standing for several messages of one chat, the latest one follows.
+            const QString first = QString(ngettext("%1 new message", "%1 new messages", burst.count)).arg(burst.count);
+            body = first + "\n" + body;
+        }
+    }
+
     QJsonObject card;
-    card["icon"] = getAvatar(chatId);
+    card["icon"] = avatar.isEmpty() ? QString() : "file://" + avatar; // no-i18n // TODO else: generic avatar
     card["summary"] = summary;  // no-i18n
     card["body"]    = body;     // no-i18n
     card["actions"] = actions;  // no-i18n
-    card["popup"]   = true;     // no-i18n // TODO make setting
+    card["popup"]   = alert;    // no-i18n
     card["persist"] = true;     // no-i18n // TODO make setting
 
     QJsonObject emblem;
@@ -298,8 +180,8 @@ QJsonObject PushHelper::pushToPostalMessage(const QJsonObject &push, QString &ta
     notification["tag"] = tag;                  // no-i18n
     notification["card"] = card;                // no-i18n
     notification["emblem-counter"] = emblem;    // no-i18n
-    notification["sound"] = true;               // no-i18n // TODO make setting
-    notification["vibrate"] = true;             // no-i18n // TODO make setting
+    notification["sound"] = alert;              // no-i18n
+    notification["vibrate"] = alert;            // no-i18n
 
     QJsonObject postalMessage = QJsonObject();
     postalMessage["notification"] = notification; // no-i18n
@@ -307,53 +189,32 @@ QJsonObject PushHelper::pushToPostalMessage(const QJsonObject &push, QString &ta
     return postalMessage;
 }
 
-// TODO: This should be placed in a class shared between app, scope, push.
-
-QString PushHelper::getPrimaryPhoneNumber() {
-    QString number;
-
-    QFile db(PROFILES_PATH);
-    if (!db.exists()) {
-        qCritical() << "profiles db: file not found";
-        return number;
-    }
-
-    QSqlDatabase profiles = QSqlDatabase::addDatabase("QSQLITE", "tg-profiles");
-    profiles.setDatabaseName(PROFILES_PATH);
+bool PushHelper::readPeerHint(qint64 peerId, bool isChat, QString &account, QString &name, QString &avatar) {
+    using namespace PeerHints;
 
-    if (!profiles.open()) {
-        qCritical() << "profiles db: failed to open";
-        return number;
+    // One mapping and a binary search, the notification path does not open
+    // SQLite or list the avatar directories.
+    QFile file(CONFIG_PATH + "/" + HINTS_FILE_NAME);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
     }
-
-    QSqlQuery query(profiles);
-    query.prepare("SELECT number FROM Profiles ORDER BY rowid LIMIT 1");
-    if (!query.exec() || !query.first()) {
-        qCritical() << "profiles db: failed to query phone number";
-        return number;
+    const qint64 size = file.size();
+    const uchar *data = size > 0 ? file.map(0, size) : 0;
+
+    const Header *header;
+    const Entry *entries;
+    const char *strings;
+    if (!parse(data, size, header, entries, strings)) {
+        if (DEBUG) qDebug() << "peer hints: not readable"; // no-i18n
+        return false;
     }
 
-    int numberIndex = query.record().indexOf("number");
-    number = query.value(numberIndex).toString();
-    profiles.close();
-
-    return number;
-}
-
-QString PushHelper::getAvatar(qint64 peerId) {
-    QString avatar = "";
-    QString phone = getPrimaryPhoneNumber();
-    if (!phone.isEmpty()) {
-        QStringList nameFilters;
-        nameFilters << "*.jpeg" << "*.jpeg";
-
-        QDir profilesDir(PROFILE_DIR_FMT.arg(phone).arg(peerId));
-        profilesDir.setNameFilters(nameFilters);
-
-        QStringList fileNames = profilesDir.entryList();
-        if (fileNames.length() > 0) {
-            avatar = PROFILE_FILE_FMT.arg(phone).arg(peerId).arg(fileNames[0]);
-        } // TODO else: generic avatar
+    const Entry *entry = find(header, entries, isChat ? PEER_CHAT : PEER_USER, peerId);
+    if (!entry) {
+        return false;
     }
-    return avatar;
+    account = string(header, strings, entry->account);
+    name = string(header, strings, entry->name);
+    avatar = string(header, strings, entry->avatar);
+    return true;
 }
@@ -31,15 +31,12 @@ protected:
     void dismissNotification(const QString &tag);
     QJsonObject pushToPostalMessage(const QJsonObject &push, QString &tag);
 
-    QString getPrimaryPhoneNumber();
-    QString getAvatar(qint64 peerId);
+    bool readPeerHint(qint64 peerId, bool isChat, QString &account, QString &name, QString &avatar);
 
 private:
     PushClient mPushClient;
     QString mInfile;
     QString mOutfile;
-
-    QJsonObject mPostalMessage;
 };
 
 #endif
@@ -0,0 +1,49 @@
+# Standalone benchmark for the scope's queries, not part of the click
+# package. Build and run it on the device or in the click chroot:
+#
+#   mkdir build-bench && cd build-bench && qmake ../bench && make
+#   ./scope-bench --help
+
+QT -= gui
+QT += sql concurrent
+CONFIG += console c++11 link_pkgconfig
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = scope-bench
+
+PKG_CONFIG_LIBDIR=$$[QT_INSTALL_LIBS]/pkgconfig
+PKGCONFIG += libunity-scopes
+LIBS += -lunity-scopes -lsqlite3
+
+# Config and cache paths of the scope point into this scratch home instead
+# of /home/phablet, see shared/accountpaths.h.
+DEFINES += TELEGRAM_HOME=\\\"/tmp/telegram-scope-bench\\\"
+DEFINES += SCHEMA_PATH=\\\"$$PWD/../../app/database/database.sql\\\"
+
+INCLUDEPATH += .. ../../shared
+include(../../shared/shared.pri)
+
+MOC_DIR = mocs
+OBJECTS_DIR = objs
+
+SOURCES += \
+    main.cpp \
+    syntheticdatabase.cpp \
+    ../query.cpp \
+    ../messageindex.cpp \
+    ../session.cpp \
+    ../queryplan.cpp \
+    ../resultstream.cpp \
+    ../snapshot.cpp
+
+HEADERS += \
+    ../../shared/benchoptions.h \
+    syntheticdatabase.h \
+    benchreply.h \
+    ../query.h \
+    ../messageindex.h \
+    ../session.h \
+    ../queryplan.h \
+    ../resultstream.h \
+    ../snapshot.h \
+    ../collectingreply.h
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <unity/scopes/CannedQuery.h>
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/Department.h>
+#include <unity/scopes/FilterBase.h>
+#include <unity/scopes/FilterState.h>
+#include <unity/scopes/OperationInfo.h>
+#include <unity/scopes/SearchReply.h>
+#include <unity/scopes/testing/Category.h>
+
+#include <exception>
+#include <map>
+#include <string>
+
+using namespace unity::scopes;
+
+// Stands in for the Dash: keeps categories, counts results and never closes.
+// Methods are listed without override so that the same file builds against
+// the libunity-scopes versions that add or drop members of SearchReply.
+
+class BenchReply : public SearchReply
+{
+public:
+    int results() const { return mResults; }
+
+    Category::SCPtr register_category(std::string const &id, std::string const &title, std::string const &icon,
+                                      CategoryRenderer const &renderer) {
+        auto category = std::make_shared<testing::Category>(id, title, icon, renderer);
+        mCategories[id] = category;
+        return category;
+    }
+
+    Category::SCPtr register_category(std::string const &id, std::string const &title, std::string const &icon,
+                                      CannedQuery const &, CategoryRenderer const &renderer) {
+        return register_category(id, title, icon, renderer);
+    }
+
+    void register_category(Category::SCPtr category) {
+        mCategories[category->id()] = category;
+    }
+
+    Category::SCPtr lookup_category(std::string const &id) {
+        auto it = mCategories.find(id);
+        return it == mCategories.end() ? nullptr : it->second;
+    }
+
+    bool push(CategorisedResult const &) {
+        mResults++;
+        return true;
+    }
+
+    bool push(Filters const &, FilterState const &) { return true; }
+    void push(Filters const &) {}
+    void register_departments(Department::SCPtr const &) {}
+    void push_surfacing_results_from_cache() {}
+
+    void finished() {}
+    void error(std::exception_ptr) {}
+    void info(OperationInfo const &) {}
+
+    std::string endpoint() { return std::string(); }
+    std::string identity() { return "bench"; }
+    std::string target_category() { return std::string(); }
+    int64_t timeout() { return -1; }
+    std::string to_string() { return "bench"; }
+
+private:
+    std::map<std::string, Category::SCPtr> mCategories;
+    int mResults = 0;
+};
@@ -0,0 +1,127 @@
+#include <unity/scopes/CannedQuery.h>
+#include <unity/scopes/SearchMetadata.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "benchoptions.h"
+#include "benchreply.h"
+#include "query.h"
+#include "session.h"
+#include "syntheticdatabase.h"
+
+// Runs the scope's queries the way the Dash does, against one session that
+// lives across runs, and prints latency percentiles and statement counts
+// per mode. The first run of each mode is a warm-up and not counted; it
+// checks the plan of every statement instead, and any full scan makes the
+// exit status non-zero.
+
+struct Mode {
+    const char *name;
+    std::string query;
+    std::string keyword;
+};
+
+static const char *USAGE =
+    "Usage: scope-bench [options]\n"
+    "  --users N        users in the database (10000)\n"
+    "  --chats N        group chats (1000)\n"
+    "  --dialogs N      dialogs (2000)\n"
+    "  --messages N     messages (1000000)\n"
+    "  --photo-sizes N  photo sizes, three per photo (150000)\n"
+    "  --legacy         leave the app's scope index version at 0\n"
+    "  --accounts N     logged in accounts, searched in parallel (1)\n"
+    "  --query TEXT     search text (coffee)\n"
+    "  --runs N         timed runs per mode (50)\n";
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    SyntheticCounts counts;
+    int runs = 50;
+    QString search = "coffee";
+
+    const int status = BenchOptions::parse(app.arguments(), USAGE, QStringList() << "--legacy",
+                                           [&](QString const &arg, QString const &value) -> bool {
+        if (arg == "--legacy") counts.indexed = false;
+        else if (arg == "--users") counts.users = value.toInt();
+        else if (arg == "--chats") counts.chats = value.toInt();
+        else if (arg == "--dialogs") counts.dialogs = value.toInt();
+        else if (arg == "--messages") counts.messages = value.toInt();
+        else if (arg == "--photo-sizes") counts.photoSizes = value.toInt();
+        else if (arg == "--accounts") counts.accounts = qMax(1, value.toInt());
+        else if (arg == "--runs") runs = qMax(1, value.toInt());
+        else if (arg == "--query") search = value;
+        else return false;
+        return true;
+    });
+    if (status >= 0) {
+        return status;
+    }
+
+    if (!SyntheticDatabase(counts).build()) {
+        return 1;
+    }
+
+    const std::vector<Mode> modes = {
+        { "surfacing", "", "" },
+        { "search", search.toStdString(), "" },
+        { "recent", "", KEYWORD_RECENT },
+        { "photos", "", KEYWORD_PHOTOS_TELEGRAM },
+    };
+
+    auto session = std::make_shared<TelegramSession>();
+    const QString scopeDir = app.applicationDirPath();
+
+    printf("%-10s %8s %8s %8s %10s %10s %8s\n", "mode", "p50 ms", "p95 ms", "p99 ms", "prepared", "reused", "results");
+    for (auto &mode: modes) {
+        CannedQuery query("com.ubuntu.telegram_sctelegram", mode.query, "");
+        SearchMetadata metadata("en_US", "phone");
+        if (!mode.keyword.empty()) {
+            metadata.set_aggregated_keywords(std::set<std::string>{ mode.keyword });
+        }
+
+        std::vector<qint64> elapsed;
+        qint64 prepared = 0;
+        qint64 reused = 0;
+        int results = 0;
+        for (int run = 0; run <= runs; run++) {
+            auto reply = std::make_shared<BenchReply>();
+            TelegramQuery telegramQuery(query, metadata, scopeDir, session);
+
+            session->setChecksPlans(run == 0);
+            QElapsedTimer timer;
+            timer.start();
+            telegramQuery.run(reply);
+            const qint64 nsecs = timer.nsecsElapsed();
+            if (run == 0) continue;
+
+            int runPrepared, runReused;
+            session->statementCounts(runPrepared, runReused);
+            elapsed.push_back(nsecs);
+            prepared += runPrepared;
+            reused += runReused;
+            results = reply->results();
+        }
+
+        std::sort(elapsed.begin(), elapsed.end());
+        printf("%-10s %8.2f %8.2f %8.2f %10.1f %10.1f %8d\n", mode.name,
+               BenchOptions::percentile(elapsed, 0.50, 1e6), BenchOptions::percentile(elapsed, 0.95, 1e6),
+               BenchOptions::percentile(elapsed, 0.99, 1e6),
+               double(prepared) / runs, double(reused) / runs, results);
+    }
+
+    const QStringList scans = session->fullScans();
+    for (auto &scan: scans) {
+        fprintf(stderr, "full scan: %s\n", qPrintable(scan));
+    }
+    return scans.isEmpty() ? 0 : 1;
+}
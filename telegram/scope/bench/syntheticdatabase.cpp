@@ -0,0 +1,358 @@
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTextStream>
+
+#include <vector>
+
+#include "config.h"
+#include "searchkeys.h"
+#include "syntheticdatabase.h"
+
+static const char *WORDS[] = {
+    "hello", "meeting", "tomorrow", "photo", "dinner", "train", "coffee", "weekend", "call", "later",
+    "thanks", "great", "office", "birthday", "party", "project", "review", "lunch", "movie", "ticket"
+};
+static const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+static const int SIZES_PER_PHOTO = 3;
+static const int UNREAD_DIALOGS = 5;
+
+SyntheticDatabase::SyntheticDatabase(SyntheticCounts const &counts)
+        : mCounts(counts) {
+}
+
+bool SyntheticDatabase::writeSearchKeys(QSqlDatabase &db) {
+    QSqlQuery names(db);
+    names.setForwardOnly(true);
+    QSqlQuery insert(db);
+    insert.prepare("INSERT OR IGNORE INTO PeerSearchKeys (peerType, key, peer) VALUES (:peerType, :key, :peer)");
+
+    const QString sql[] = {
+        QString("SELECT %1, id, firstName || ' ' || lastName FROM Users").arg((unsigned int)PeerType::typePeerUser),
+        QString("SELECT %1, id, title FROM Chats").arg((unsigned int)PeerType::typePeerChat)
+    };
+    for (auto &select: sql) {
+        if (!names.exec(select)) {
+            qCritical().noquote() << TAG << "search keys:" << names.lastError().text();
+            return false;
+        }
+        while (names.next()) {
+            for (auto &key: SearchKeys::keys(names.value(2).toString())) {
+                insert.bindValue(":peerType", names.value(0));
+                insert.bindValue(":key", key);
+                insert.bindValue(":peer", names.value(1));
+                if (!insert.exec()) {
+                    qCritical().noquote() << TAG << "search keys:" << insert.lastError().text();
+                    return false;
+                }
+            }
+        }
+    }
+
+    QSqlQuery query(db);
+    return query.exec("DELETE FROM PeerSearchPending");
+}
+
+QString SyntheticDatabase::countsKey() const {
+    return QString("%1/%2/%3/%4/%5/%6").arg(mCounts.users).arg(mCounts.chats).arg(mCounts.dialogs)
+            .arg(mCounts.messages).arg(mCounts.photoSizes).arg(mCounts.indexed);
+}
+
+bool SyntheticDatabase::build() {
+    if (!writeProfiles()) {
+        return false;
+    }
+
+    const QString path = DATABASE_PATH_FMT.arg(number());
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    const QString name = "bench-build";
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+        db.setDatabaseName(path);
+        if (!db.open()) {
+            qCritical().noquote() << TAG << "could not open" << path;
+        } else {
+            QSqlQuery query(db);
+            if (query.exec("SELECT gvalue FROM General WHERE gkey = 'benchCounts'") && query.next()
+                    && query.value(0).toString() == countsKey()) {
+                qDebug().noquote() << TAG << "reusing" << path;
+                ok = true;
+            } else {
+                query.finish();
+                db.close();
+                QFile::remove(path);
+                ok = db.open() && writeSchema(db) && writeRows(db);
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(name);
+
+    // The other accounts read the same rows from files of their own, so
+    // that their queries do not share a page cache or a lock.
+    for (int account = 1; ok && account < mCounts.accounts; account++) {
+        const QString copy = DATABASE_PATH_FMT.arg(number(account));
+        QDir().mkpath(QFileInfo(copy).absolutePath());
+        QFile::remove(copy);
+        ok = QFile::copy(path, copy);
+        if (!ok) {
+            qCritical().noquote() << TAG << "could not copy" << path << "to" << copy;
+        }
+    }
+    return ok;
+}
+
+bool SyntheticDatabase::writeProfiles() {
+    QDir().mkpath(QFileInfo(PROFILES_PATH).absolutePath());
+
+    const QString name = "bench-profiles";
+    bool ok;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+        db.setDatabaseName(PROFILES_PATH);
+        QSqlQuery query(db);
+        ok = db.open()
+                && query.exec("CREATE TABLE IF NOT EXISTS Profiles (number TEXT PRIMARY KEY)")
+                && query.exec("DELETE FROM Profiles");
+        for (int account = 0; ok && account < mCounts.accounts; account++) {
+            ok = query.exec(QString("INSERT INTO Profiles (number) VALUES ('%1')").arg(number(account)));
+        }
+        if (!ok) {
+            qCritical().noquote() << TAG << "could not write profiles:" << query.lastError().text();
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+    return ok;
+}
+
+bool SyntheticDatabase::writeSchema(QSqlDatabase &db) {
+    QFile file(SCHEMA_PATH);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical().noquote() << TAG << "could not read" << SCHEMA_PATH;
+        return false;
+    }
+
+    // One statement per exec(); trigger bodies have their own semicolons
+    // and only end at END;.
+    QStringList statements;
+    QString current;
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine();
+        if (line.trimmed().isEmpty() && current.isEmpty()) continue;
+
+        current += line + "\n";
+        const bool inTrigger = current.trimmed().startsWith("CREATE TRIGGER");
+        const QString trimmed = line.trimmed();
+        if (trimmed.endsWith(";") && (!inTrigger || trimmed == "END;")) {
+            statements << current;
+            current.clear();
+        }
+    }
+
+    QSqlQuery query(db);
+    for (auto &sql: statements) {
+        if (!query.exec(sql)) {
+            qCritical().noquote() << TAG << "schema:" << query.lastError().text() << "in" << sql;
+            return false;
+        }
+    }
+    return query.exec("CREATE TABLE IF NOT EXISTS General (gkey TEXT NOT NULL, gvalue TEXT NOT NULL, PRIMARY KEY (gkey))");
+}
+
+bool SyntheticDatabase::writeRows(QSqlDatabase &db) {
+    QElapsedTimer timer;
+    timer.start();
+    qsrand(1);
+
+    QSqlQuery query(db);
+    query.exec("PRAGMA synchronous = OFF");
+    query.exec("PRAGMA journal_mode = MEMORY");
+    db.transaction();
+
+    const QString ownPhone = number().mid(1);
+
+    QSqlQuery users(db);
+    users.prepare("INSERT INTO Users (id, phone, firstName, lastName, username, type, "
+                  "photoBigLocalId, photoBigSecret, photoBigDcId, photoBigVolumeId, "
+                  "photoSmallLocalId, photoSmallSecret, photoSmallDcId, photoSmallVolumeId) "
+                  "VALUES (:id, :phone, :firstName, :lastName, '', 0, 0, 0, 0, 0, :localId, 0, 1, :volumeId)");
+    for (int id = 1; id <= mCounts.users; id++) {
+        users.bindValue(":id", id);
+        users.bindValue(":phone", id == 1 ? ownPhone : QString::number(15550000000LL + id));
+        users.bindValue(":firstName", QString("%1%2").arg(WORDS[id % WORD_COUNT]).arg(id));
+        users.bindValue(":lastName", QString(WORDS[(id / WORD_COUNT) % WORD_COUNT]));
+        // Every other user has a profile photo.
+        users.bindValue(":localId", id % 2 ? id : 0);
+        users.bindValue(":volumeId", id % 2 ? 100 + id % 7 : 0);
+        if (!users.exec()) {
+            qCritical().noquote() << TAG << "users:" << users.lastError().text();
+            return false;
+        }
+    }
+
+    QSqlQuery chats(db);
+    chats.prepare("INSERT INTO Chats (id, participantsCount, title, "
+                  "photoBigLocalId, photoBigSecret, photoBigDcId, photoBigVolumeId, "
+                  "photoSmallLocalId, photoSmallSecret, photoSmallDcId, photoSmallVolumeId) "
+                  "VALUES (:id, 10, :title, 0, 0, 0, 0, 0, 0, 0, 0)");
+    for (int id = 1; id <= mCounts.chats; id++) {
+        chats.bindValue(":id", id);
+        chats.bindValue(":title", QString("%1 %2").arg(WORDS[id % WORD_COUNT]).arg(id));
+        if (!chats.exec()) {
+            qCritical().noquote() << TAG << "chats:" << chats.lastError().text();
+            return false;
+        }
+    }
+
+    // A quarter of the dialogs are chats, the rest private chats with
+    // anyone but the own user.
+    struct Dialog {
+        qint64 peer;
+        bool isChat;
+        qint64 topMessage;
+    };
+    std::vector<Dialog> dialogs;
+    const int chatDialogs = qMin(mCounts.dialogs / 4, mCounts.chats);
+    const int userDialogs = qMin(mCounts.dialogs - chatDialogs, mCounts.users - 1);
+    for (int i = 0; i < chatDialogs + userDialogs; i++) {
+        Dialog dialog;
+        dialog.isChat = i < chatDialogs;
+        dialog.peer = dialog.isChat ? i + 1 : i - chatDialogs + 2;
+        dialog.topMessage = 0;
+        dialogs.push_back(dialog);
+    }
+    if (dialogs.empty()) {
+        qCritical().noquote() << TAG << "no dialogs";
+        return false;
+    }
+
+    QSqlQuery messages(db);
+    messages.prepare("INSERT INTO Messages (id, toId, toPeerType, unread, fromId, out, date, message, actionType, mediaType, mediaPhoto) "
+                     "VALUES (:id, :toId, :toPeerType, :unread, :fromId, :out, :date, :message, 0, :mediaType, :mediaPhoto)");
+    QSqlQuery sizes(db);
+    sizes.prepare("INSERT INTO PhotoSizes (pid, h, type, size, w, locationLocalId, locationSecret, locationDcId, locationVolumeId) "
+                  "VALUES (:pid, :h, :type, :size, :w, :localId, 0, 1, :volumeId)");
+    QSqlQuery downloaded(db);
+    downloaded.prepare("INSERT OR REPLACE INTO DownloadedMedia (peer, media, path) VALUES (:peer, :media, :path)");
+    QSqlQuery thumbnail(db);
+    thumbnail.prepare("INSERT OR REPLACE INTO MediaThumbnails (peer, media, path) VALUES (:peer, :media, :path)");
+
+    const int photos = mCounts.photoSizes / SIZES_PER_PHOTO;
+    const int photoEvery = photos > 0 ? qMax(1, mCounts.messages / photos) : 0;
+    const qint64 now = QDateTime::currentDateTime().toTime_t();
+    const char *types[] = { "s", "m", "x" };
+
+    int photoCount = 0;
+    for (int i = 0; i < mCounts.messages; i++) {
+        const qint64 id = i + 1;
+        Dialog &dialog = dialogs[(qint64(i) * 7919) % dialogs.size()];
+        const bool out = qrand() % 3 == 0;
+        const bool isPhoto = photoEvery > 0 && i % photoEvery == 0 && photoCount < photos;
+
+        QStringList words;
+        for (int w = 0; w < 3 + qrand() % 8; w++) {
+            words << WORDS[qrand() % WORD_COUNT];
+        }
+
+        messages.bindValue(":id", id);
+        messages.bindValue(":toId", (dialog.isChat || out) ? dialog.peer : 1);
+        messages.bindValue(":toPeerType", (unsigned int)(dialog.isChat ? PeerType::typePeerChat : PeerType::typePeerUser));
+        messages.bindValue(":unread", false);
+        messages.bindValue(":fromId", out ? 1 : (dialog.isChat ? 2 + qrand() % qMax(1, mCounts.users - 1) : dialog.peer));
+        messages.bindValue(":out", out);
+        // One message a minute up to now, so today always has some.
+        messages.bindValue(":date", now - (mCounts.messages - i) * 60);
+        messages.bindValue(":message", isPhoto ? QString() : words.join(' '));
+        messages.bindValue(":mediaType", (unsigned int)(isPhoto ? MessageMedia::typeMessageMediaPhoto : MessageMedia::typeMessageMediaEmpty));
+        messages.bindValue(":mediaPhoto", isPhoto ? id : 0);
+        if (!messages.exec()) {
+            qCritical().noquote() << TAG << "messages:" << messages.lastError().text();
+            return false;
+        }
+        dialog.topMessage = id;
+
+        if (!isPhoto) continue;
+        photoCount++;
+
+        const qint64 volumeId = 1000 + id % 97;
+        for (int s = 0; s < SIZES_PER_PHOTO; s++) {
+            sizes.bindValue(":pid", id);
+            sizes.bindValue(":h", 90 << s);
+            sizes.bindValue(":type", types[s]);
+            sizes.bindValue(":size", 4000 << (2 * s));
+            sizes.bindValue(":w", 120 << s);
+            sizes.bindValue(":localId", id * SIZES_PER_PHOTO + s);
+            sizes.bindValue(":volumeId", volumeId);
+            if (!sizes.exec()) {
+                qCritical().noquote() << TAG << "photo sizes:" << sizes.lastError().text();
+                return false;
+            }
+        }
+
+        // Every other photo was downloaded; the files themselves are not
+        // needed once the app has indexed them.
+        if (photoCount % 2 == 0) {
+            const QString media = QString("%1_%2").arg(volumeId).arg(id * SIZES_PER_PHOTO);
+            downloaded.bindValue(":peer", dialog.peer);
+            downloaded.bindValue(":media", media);
+            downloaded.bindValue(":path", QString("%1/%2/downloads/%3/%4.jpeg").arg(CACHE_PATH).arg(number()).arg(dialog.peer).arg(media));
+            thumbnail.bindValue(":peer", dialog.peer);
+            thumbnail.bindValue(":media", media);
+            thumbnail.bindValue(":path", QString("%1/%2/cards/%3/%4.jpeg").arg(CACHE_PATH).arg(number()).arg(dialog.peer).arg(media));
+            if (!downloaded.exec() || !thumbnail.exec()) {
+                qCritical().noquote() << TAG << "downloads:" << downloaded.lastError().text() << thumbnail.lastError().text();
+                return false;
+            }
+        }
+    }
+
+    // The dialogs last written to are the most recent ones, some of them unread.
+    QSqlQuery dialogInsert(db);
+    dialogInsert.prepare("INSERT INTO Dialogs (peer, peerType, topMessage, unreadCount, encrypted) "
+                         "VALUES (:peer, :peerType, :topMessage, :unreadCount, 0)");
+    for (auto &dialog: dialogs) {
+        const bool unread = dialog.topMessage > mCounts.messages - UNREAD_DIALOGS;
+        dialogInsert.bindValue(":peer", dialog.peer);
+        dialogInsert.bindValue(":peerType", (unsigned int)(dialog.isChat ? PeerType::typePeerChat : PeerType::typePeerUser));
+        dialogInsert.bindValue(":topMessage", dialog.topMessage);
+        dialogInsert.bindValue(":unreadCount", unread ? 3 : 0);
+        if (!dialogInsert.exec()) {
+            qCritical().noquote() << TAG << "dialogs:" << dialogInsert.lastError().text();
+            return false;
+        }
+    }
+
+    // What the app's indexer does with the peers the schema's triggers queued.
+    if (mCounts.indexed && !writeSearchKeys(db)) {
+        return false;
+    }
+
+    QSqlQuery general(db);
+    general.prepare("INSERT OR REPLACE INTO General (gkey, gvalue) VALUES (:key, :value)");
+    general.bindValue(":key", "scopeIndexVersion");
+    general.bindValue(":value", mCounts.indexed ? SCOPE_INDEX_RECENT_MEDIA : 0);
+    general.exec();
+    general.bindValue(":key", "benchCounts");
+    general.bindValue(":value", countsKey());
+    general.exec();
+
+    if (!db.commit()) {
+        qCritical().noquote() << TAG << "commit:" << db.lastError().text();
+        return false;
+    }
+    query.exec("ANALYZE");
+
+    qDebug().noquote() << TAG << "built" << mCounts.messages << "messages," << photoCount << "photos in"
+                       << dialogs.size() << "dialogs in" << timer.elapsed() << "ms";
+    return true;
+}
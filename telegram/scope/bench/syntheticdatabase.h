@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QSqlDatabase>
+#include <QString>
+
+// Builds the files the scope reads, profiles.sqlite and an account's
+// database.db, under the scratch home from config.h. The schema comes from
+// app/database/database.sql; the rows are generated from a fixed seed, so
+// two runs with the same counts read the same data.
+
+struct SyntheticCounts {
+    int users = 10000;
+    int chats = 1000;
+    int dialogs = 2000;
+    int messages = 1000000;
+    int photoSizes = 150000;    // three sizes per photo message
+    bool indexed = true;        // as after the app's scope index upgrade
+    int accounts = 1;           // profiles, each with a copy of the database
+};
+
+class SyntheticDatabase
+{
+public:
+    SyntheticDatabase(SyntheticCounts const &counts);
+
+    static QString number(int account = 0) { return QString("+1555%1").arg(account + 1, 7, 10, QChar('0')); }
+
+    // Reuses the database of an earlier run with the same counts.
+    bool build();
+
+private:
+    const QString TAG = "Bench:";
+
+    bool writeProfiles();
+    bool writeSchema(QSqlDatabase &db);
+    bool writeRows(QSqlDatabase &db);
+    bool writeSearchKeys(QSqlDatabase &db);
+    QString countsKey() const;
+
+    SyntheticCounts mCounts;
+};
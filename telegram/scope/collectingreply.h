@@ -0,0 +1,85 @@
+#pragma once
+
+#include <unity/scopes/CannedQuery.h>
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/CategoryRenderer.h>
+#include <unity/scopes/Department.h>
+#include <unity/scopes/FilterBase.h>
+#include <unity/scopes/FilterState.h>
+#include <unity/scopes/OperationInfo.h>
+#include <unity/scopes/SearchReply.h>
+#include <unity/scopes/Variant.h>
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace unity::scopes;
+
+// Reply handed to the query of one account when several are searched at
+// once. The merging query registers every category on the real reply before
+// the accounts run; this one hands those out and keeps each result as its
+// category and attributes instead of sending it, so that TelegramQuery can
+// merge them with the other accounts' before anything reaches the Dash.
+
+class CollectingReply : public SearchReply
+{
+public:
+    struct Collected {
+        std::string categoryId;
+        std::string uri;
+        VariantMap attrs;
+    };
+
+    explicit CollectingReply(SearchReplyProxy const &reply) : mReply(reply) {}
+
+    // In the order they were pushed.
+    std::vector<Collected> const &results() const { return mResults; }
+
+    // Categories can not be added once the accounts run, these return the
+    // one already registered under id.
+    Category::SCPtr register_category(std::string const &id, std::string const &, std::string const &,
+                                      CategoryRenderer const &) override {
+        return lookup_category(id);
+    }
+
+    Category::SCPtr register_category(std::string const &id, std::string const &, std::string const &,
+                                      CannedQuery const &, CategoryRenderer const &) override {
+        return lookup_category(id);
+    }
+
+    void register_category(Category::SCPtr) override {}
+
+    Category::SCPtr lookup_category(std::string const &id) override {
+        return mReply->lookup_category(id);
+    }
+
+    bool push(CategorisedResult const &result) override {
+        QMutexLocker locker(&mMutex);
+        mResults.push_back({ result.category()->id(), result.uri(), result.serialize()["attrs"].get_dict() }); // no-i18n
+        return true;
+    }
+
+    bool push(Filters const &, FilterState const &) override { return true; }
+    void push(Filters const &) override {}
+    void register_departments(Department::SCPtr const &) override {}
+    void push_surfacing_results_from_cache() override {}
+
+    void finished() override {}
+    void error(std::exception_ptr) override {}
+    void info(OperationInfo const &) override {}
+
+    std::string endpoint() override { return std::string(); }
+    std::string identity() override { return "collect"; } // no-i18n
+    std::string target_category() override { return std::string(); }
+    int64_t timeout() override { return -1; }
+    std::string to_string() override { return "collect"; } // no-i18n
+
+private:
+    SearchReplyProxy mReply;
+    QMutex mMutex;
+    std::vector<Collected> mResults;
+};
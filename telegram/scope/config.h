@@ -1,5 +1,6 @@
 #pragma once
 
+#include "accountpaths.h"
 #include "i18n.h"
 #include <string>
 
@@ -10,10 +11,31 @@ const int LIMIT_SURFACE = 10;
 const int LIMIT_MEDIA   =  9;
 const int LIMIT_SEARCH  = 30;
 
-const QString CONFIG_PATH       = "/home/phablet/.config/com.ubuntu.telegram";
-const QString CACHE_PATH        = "/home/phablet/.cache/com.ubuntu.telegram";
-const QString PROFILES_PATH     = CONFIG_PATH + "/profiles.sqlite";
-const QString DATABASE_PATH_FMT = CONFIG_PATH + "/%1/database.db";
+// With several accounts logged in their queries run in parallel; what has
+// not finished after this many milliseconds is cancelled.
+const int ACCOUNTS_BUDGET = 400;
+
+// Full-text message search: how many of the most recent matches get ranked,
+// and how the excerpt shown on the card is cut.
+const int SEARCH_WINDOW      = 200;
+const int SNIPPET_TOKENS     = 12;
+const QString SNIPPET_ELLIPSIS = "\u2026";  // no-i18n
+const QString HIGHLIGHT_START  = "<b>";      // no-i18n
+const QString HIGHLIGHT_END    = "</b>";     // no-i18n
+
+// Versions of the app's scope index (app/scopeindexer.cpp) that added
+// something the scope reads.
+const int SCOPE_INDEX_DOWNLOADS = 3;
+const int SCOPE_INDEX_THUMBNAILS = 4;
+const int SCOPE_INDEX_PEER_SEARCH = 5;
+const int SCOPE_INDEX_DIALOG_ORDER = 6;
+const int SCOPE_INDEX_RECENT_MEDIA = 7;
+
+// Under TELEGRAM_HOME, see shared/accountpaths.h.
+const QString CONFIG_PATH       = AccountPaths::configPath();
+const QString CACHE_PATH        = AccountPaths::cachePath();
+const QString PROFILES_PATH     = AccountPaths::profilesPath();
+const QString DATABASE_PATH_FMT = AccountPaths::databasePath("%1");
 
 const QString PROFILE_PATH_FMT          = "file://" + CACHE_PATH + "/%1/downloads/%2/profile/%3.jpeg";
 const QString PHOTO_PATH_FMT            = "file://" + CACHE_PATH + "/%1/downloads/%2/%3.jpeg";
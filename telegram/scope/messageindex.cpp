@@ -0,0 +1,168 @@
+#include <QDebug>
+#include <QRegExp>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+#include "config.h"
+#include "messageindex.h"
+#include "session.h"
+
+// Okapi BM25 parameters, the usual defaults.
+static const double BM25_K1 = 1.2;
+static const double BM25_B = 0.75;
+
+MessageIndex::MessageIndex(TelegramSession &session)
+        : mSession(session) {
+}
+
+bool MessageIndex::isAvailable() {
+    if (mAvailable < 0) {
+        QSqlQuery *query = mSession.statement("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'MessagesFts'"); // no-i18n
+        mAvailable = (query && query->exec() && query->next()) ? 1 : 0;
+        if (query) query->finish();
+        if (DEBUG) qDebug().noquote() << TAG << "message index available:" << mAvailable;
+    }
+    return mAvailable == 1;
+}
+
+bool MessageIndex::search(QString const &searchQuery, uint limit, MessageHitList &hits) {
+    const QString match = matchExpression(searchQuery);
+    if (match.isEmpty()) {
+        return true;
+    }
+
+    // Candidates are the most recent matches; ranking happens over that window
+    // only, so a common word in a long history costs the same as a rare one.
+    QSqlQuery *query = mSession.statement(
+        "SELECT docid, message, "                                               // no-i18n
+        "   snippet(MessagesFts, '', '', :ellipsis, -1, :tokens) AS snippet, "  // no-i18n
+        "   matchinfo(MessagesFts, 'pcnalx') AS info, "                         // no-i18n
+        "   offsets(MessagesFts) AS offsets "                                   // no-i18n
+        "FROM MessagesFts WHERE MessagesFts MATCH :match "                      // no-i18n
+        "ORDER BY docid DESC LIMIT :window"                                     // no-i18n
+    );
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":ellipsis", SNIPPET_ELLIPSIS);
+    query->bindValue(":tokens", SNIPPET_TOKENS);
+    query->bindValue(":match", match);
+    query->bindValue(":window", SEARCH_WINDOW);
+    if (!query->exec()) {
+        qCritical().noquote() << TAG << "message index search failed:" << query->lastError().text();
+        return false;
+    }
+
+    while (query->next()) {
+        MessageHit hit;
+        hit.id = query->value(0).toLongLong();
+        hit.text = query->value(1).toString();
+        hit.snippet = query->value(2).toString();
+        hit.rank = rank(query->value(3).toByteArray());
+        hit.offsets = query->value(4).toByteArray();
+        hits.push_back(hit);
+    }
+    query->finish();
+
+    // Equal ranks keep the recency order from the query.
+    std::stable_sort(hits.begin(), hits.end(), [](MessageHit const &a, MessageHit const &b) {
+        return a.rank > b.rank;
+    });
+    if (hits.size() > limit) {
+        hits.resize(limit);
+    }
+
+    for (auto &hit: hits) {
+        hit.highlighted = highlight(hit.text, hit.offsets);
+        hit.offsets.clear();
+    }
+
+    if (DEBUG) qDebug().noquote() << TAG << "message index:" << match << "->" << hits.size() << "hits";
+    return true;
+}
+
+QString MessageIndex::matchExpression(QString const &searchQuery) {
+    // Every word must match as a prefix. Words are quoted so that user input
+    // can never be read as FTS operators (AND, OR, NEAR, -, column filters).
+    QStringList terms;
+    for (QString word: searchQuery.split(QRegExp("\\s+"), QString::SkipEmptyParts)) { // no-i18n
+        word.remove('"').remove('*');
+
+        bool hasText = false;
+        for (const QChar c: word) {
+            if (c.isLetterOrNumber()) {
+                hasText = true;
+                break;
+            }
+        }
+        if (hasText) {
+            terms << QString("\"%1*\"").arg(word); // no-i18n
+        }
+    }
+    return terms.join(' ');
+}
+
+double MessageIndex::rank(QByteArray const &matchInfo) {
+    // matchinfo 'pcnalx': phrase count, column count, row count, average
+    // tokens per column, tokens per column in this row, then three hit
+    // counters per phrase and column.
+    const quint32 *info = reinterpret_cast<const quint32 *>(matchInfo.constData());
+    const int size = matchInfo.size() / sizeof(quint32);
+    if (size < 3) {
+        return 0;
+    }
+
+    const quint32 phrases = info[0];
+    const quint32 columns = info[1];
+    const double rows = info[2];
+    const quint32 *averages = info + 3;
+    const quint32 *lengths = averages + columns;
+    const quint32 *hits = lengths + columns;
+    if (hits + 3 * phrases * columns > info + size) {
+        return 0;
+    }
+
+    double score = 0;
+    for (quint32 i = 0; i < phrases; i++) {
+        for (quint32 j = 0; j < columns; j++) {
+            const quint32 *phrase = hits + 3 * (i * columns + j);
+            const double frequency = phrase[0];
+            const double documents = phrase[2];
+            if (frequency == 0) continue;
+
+            // Clamped so that words found in most messages still count a little.
+            const double idf = std::max(std::log((rows - documents + 0.5) / (documents + 0.5)), 0.01);
+            const double average = averages[j] > 0 ? averages[j] : 1;
+            const double norm = 1 - BM25_B + BM25_B * lengths[j] / average;
+            score += idf * frequency * (BM25_K1 + 1) / (frequency + BM25_K1 * norm);
+        }
+    }
+    return score;
+}
+
+QString MessageIndex::highlight(QString const &text, QByteArray const &offsets) {
+    // offsets() reports "column term byte-offset byte-size" per match, in
+    // UTF-8 bytes of the indexed text.
+    const QByteArray utf8 = text.toUtf8();
+    const QList<QByteArray> fields = offsets.split(' ');
+
+    QString result;
+    int position = 0;
+    for (int i = 0; i + 3 < fields.size(); i += 4) {
+        const int start = fields.at(i + 2).toInt();
+        const int end = start + fields.at(i + 3).toInt();
+        if (start < position || end > utf8.size()) continue;
+
+        result += QString::fromUtf8(utf8.mid(position, start - position)).toHtmlEscaped();
+        result += HIGHLIGHT_START;
+        result += QString::fromUtf8(utf8.mid(start, end - start)).toHtmlEscaped();
+        result += HIGHLIGHT_END;
+        position = end;
+    }
+    result += QString::fromUtf8(utf8.mid(position)).toHtmlEscaped();
+    return result;
+}
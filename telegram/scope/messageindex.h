@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <vector>
+
+// Ranked full-text search over the MessagesFts table the app maintains next
+// to Messages (see app/scopeindexer.cpp). Older databases may not have been
+// upgraded yet, so callers check isAvailable() and fall back to LIKE.
+
+struct MessageHit {
+    qint64 id;
+    double rank;
+    QString snippet;     // plain text excerpt around the matches
+    QString highlighted; // whole message, HTML escaped, matches wrapped in markers
+
+    QString text;
+    QByteArray offsets;
+};
+
+typedef std::vector<MessageHit> MessageHitList;
+
+class TelegramSession;
+
+class MessageIndex
+{
+public:
+    MessageIndex(TelegramSession &session);
+
+    bool isAvailable();
+    bool search(QString const &searchQuery, uint limit, MessageHitList &hits);
+
+    static QString matchExpression(QString const &searchQuery);
+    static double rank(QByteArray const &matchInfo);
+    static QString highlight(QString const &text, QByteArray const &offsets);
+
+private:
+    const QString TAG = "Telegram:";
+
+    TelegramSession &mSession;
+    int mAvailable = -1;
+};
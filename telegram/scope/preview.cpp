@@ -25,6 +25,7 @@ TelegramPreview::~TelegramPreview() {
 }
 
 void TelegramPreview::cancelled() {
+    mCancelled = true;
 }
 
 void TelegramPreview::run(unity::scopes::PreviewReplyProxy const &reply) {
@@ -42,6 +43,7 @@ void TelegramPreview::run(unity::scopes::PreviewReplyProxy const &reply) {
     layout3col.add_column({"description", "actions"});
     layout3col.add_column({"art"});
     reply->register_layout({layout1col, layout2col, layout3col});
+    if (mCancelled) return;
 
     auto r = result();
     const string type = r["type"].get_string(); // no-i18n
@@ -107,7 +109,8 @@ void TelegramPreview::run(unity::scopes::PreviewReplyProxy const &reply) {
         header.add_attribute_mapping("mascot", "avatar");
 
         PreviewWidget description("description", "text");
-        description.add_attribute_mapping("text", "title");
+        // Search results carry the whole message with the matches marked up.
+        description.add_attribute_mapping("text", r.contains("highlighted") ? "highlighted" : "title"); // no-i18n
         reply->push({header, description});
 
         string chatUri = r.uri();
@@ -134,6 +137,7 @@ void TelegramPreview::run(unity::scopes::PreviewReplyProxy const &reply) {
         // PreviewWidget description("description", "text");
         // description.add_attribute_mapping("text", "text");
         reply->push({header});
+        if (mCancelled) return;
 
         PreviewWidget art("art","image");
         art.add_attribute_mapping("source", "mediaUrl");
@@ -4,6 +4,8 @@
 #include <unity/scopes/PreviewQueryBase.h>
 #include <unity/scopes/Result.h>
 
+#include <atomic>
+
 #include "i18n.h"
 
 using unity::scopes::ActionMetadata;
@@ -19,4 +21,7 @@ public:
 
     virtual void cancelled() override;
     virtual void run(PreviewReplyProxy const &reply) override;
+
+private:
+    std::atomic<bool> mCancelled{false};
 };
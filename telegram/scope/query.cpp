@@ -6,19 +6,114 @@
 
 #include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QSqlDriver>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QtConcurrent>
 
+#include <algorithm>
+#include <climits>
+
+#include <sqlite3.h>
+
+#include "collectingreply.h"
 #include "i18n.h"
+#include "messageindex.h"
 #include "query.h"
+#include "queryplan.h"
+#include "resultstream.h"
+#include "searchkeys.h"
 #include "templates.h"
 
 using unity::scopes::Variant;
 using unity::scopes::VariantBuilder;
 
-TelegramQuery::TelegramQuery(CannedQuery const &query, SearchMetadata const &metadata, QString const &scopeDir)
-        : SearchQueryBase(query, metadata), mMetadata(metadata), mScopeDir(scopeDir) {
+// Columns read for every message card. A photo or video has one PhotoSizes
+// row per size; the first one by primary key is used, as before, but found
+// with a seek on that key instead of a sub-select per column.
+static const QString MESSAGE_COLUMNS_SQL =
+    "SELECT messages.id as mid, messages.date as mdate, out, unread, toPeerType, mediaType, mediaVideo as vid, message, fromId, toId, " // no-i18n
+    "   photoSize.locationVolumeId || '_' || photoSize.locationLocalId AS photo, "                                                     // no-i18n
+    "   videoSize.locationVolumeId || '_' || videoSize.locationLocalId AS video, ";                                                    // no-i18n
+static const QString MESSAGE_FROM_SQL =
+    "FROM Messages "                                                                                                                    // no-i18n
+    "LEFT JOIN PhotoSizes AS photoSize ON photoSize.rowid = "                                                                           // no-i18n
+    "   (SELECT rowid FROM PhotoSizes WHERE pid = mediaPhoto ORDER BY locationLocalId, locationVolumeId LIMIT 1) "                      // no-i18n
+    "LEFT JOIN PhotoSizes AS videoSize ON videoSize.rowid = "                                                                           // no-i18n
+    "   (SELECT rowid FROM PhotoSizes WHERE pid = mediaVideo ORDER BY locationLocalId, locationVolumeId LIMIT 1) ";                     // no-i18n
+
+// The app's index of downloaded files, keyed like the download directory:
+// the dialog's peer, then "<volume>_<local>" for photos or the video id.
+static const QString DOWNLOADED_JOIN_SQL = QString(
+    "LEFT JOIN DownloadedMedia AS file ON file.peer = "                                                                                 // no-i18n
+    "   (CASE WHEN toPeerType = %1 OR out THEN toId ELSE fromId END) "                                                                  // no-i18n
+    "AND file.media = (CASE mediaType "                                                                                                 // no-i18n
+    "   WHEN %2 THEN photoSize.locationVolumeId || '_' || photoSize.locationLocalId "                                                   // no-i18n
+    "   WHEN %3 THEN CAST(mediaVideo AS TEXT) END) ")                                                                                   // no-i18n
+    .arg((unsigned int)PeerType::typePeerChat)
+    .arg((unsigned int)MessageMedia::typeMessageMediaPhoto)
+    .arg((unsigned int)MessageMedia::typeMessageMediaVideo);
+
+// Card-sized copies of downloaded photos, written by the app next to the
+// downloads directory. Cards use them, the preview keeps the original.
+static const QString THUMBNAIL_JOIN_SQL =
+    "LEFT JOIN MediaThumbnails AS thumb ON thumb.peer = file.peer AND thumb.media = file.media ";                                        // no-i18n
+
+// The app's last few hundred photo and video messages with their download
+// key already resolved, newest first. However long the history, the photo
+// surface never reads more than that.
+static const QString RECENT_MEDIA_SQL =
+    "SELECT messages.id as mid, messages.date as mdate, out, unread, toPeerType, messages.mediaType AS mediaType, "                     // no-i18n
+    "   mediaVideo as vid, message, fromId, toId, recent.media AS photo, NULL AS video, file.path AS downloaded, thumb.path AS thumb " // no-i18n
+    "FROM RecentMedia AS recent "                                                                                                       // no-i18n
+    "CROSS JOIN Messages ON messages.id = recent.mid "                                                                                  // no-i18n
+    "LEFT JOIN DownloadedMedia AS file ON file.peer = recent.peer AND file.media = recent.media "                                       // no-i18n
+    + THUMBNAIL_JOIN_SQL;
+
+// Id lists are bound into a number of slots rounded up to a power of two and
+// padded with NULL, so each statement only comes in a few shapes and all of
+// them stay in the session's statement cache.
+static const int MAX_ID_SLOTS = 256;
+
+static int idSlots(int count) {
+    int slots = 1;
+    while (slots < count && slots < MAX_ID_SLOTS) slots *= 2;
+    return slots;
+}
+
+static QString idPlaceholders(int slots) {
+    QStringList placeholders;
+    for (int i = 0; i < slots; i++) {
+        placeholders << QString(":id%1").arg(i); // no-i18n
+    }
+    return placeholders.join(", ");
+}
+
+static void bindIds(QSqlQuery *query, const IdList &ids, uint from, int slots) {
+    for (int i = 0; i < slots; i++) {
+        const QString name = QString(":id%1").arg(i); // no-i18n
+        if (from + i < ids.size()) {
+            query->bindValue(name, ids[from + i]);
+        } else {
+            query->bindValue(name, QVariant(QVariant::LongLong));
+        }
+    }
+}
+
+static QString likePattern(const QString &text) {
+    QString escaped = text;
+    escaped.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_"); // no-i18n
+    return "%" + escaped + "%";
+}
+
+TelegramQuery::TelegramQuery(CannedQuery const &query, SearchMetadata const &metadata, QString const &scopeDir,
+                             std::shared_ptr<TelegramSession> const &session, QString const &account)
+        : SearchQueryBase(query, metadata), mMetadata(metadata), mScopeDir(scopeDir), mSession(session),
+          mAccount(account), mPartOfMerge(!account.isEmpty()) {
     setlocale(LC_ALL, "");
     textdomain(GETTEXT_DOMAIN.toStdString().c_str());
 }
@@ -27,6 +122,68 @@ TelegramQuery::~TelegramQuery() {
 }
 
 void TelegramQuery::cancelled() {
+    mCancelled = true;
+
+    // Stops the statement that is running right now; everything after it
+    // checks mCancelled between phases.
+    QMutexLocker locker(&mHandleMutex);
+    if (mHandle) {
+        sqlite3_interrupt(static_cast<sqlite3 *>(mHandle));
+    }
+    for (auto part: mParts) {
+        part->cancelled();
+    }
+}
+
+void TelegramQuery::setHandle(QSqlDatabase const &database) {
+    void *handle = 0;
+    if (database.isValid()) {
+        QVariant value = database.driver()->handle();
+        if (value.isValid() && qstrcmp(value.typeName(), "sqlite3*") == 0) { // no-i18n
+            handle = *static_cast<sqlite3 **>(value.data());
+        }
+    }
+
+    QMutexLocker locker(&mHandleMutex);
+    mHandle = handle;
+    if (mHandle && mCancelled) {
+        sqlite3_interrupt(static_cast<sqlite3 *>(mHandle));
+    }
+}
+
+bool TelegramQuery::stopAt(const char *phase) {
+    if (!mCancelled) return false;
+
+    if (mStoppedAt.isEmpty()) {
+        mStoppedAt = phase;
+    }
+    return true;
+}
+
+QString TelegramQuery::messageSelectSql() {
+    if (mThumbnailsIndexed) {
+        return MESSAGE_COLUMNS_SQL + "file.path AS downloaded, thumb.path AS thumb " + MESSAGE_FROM_SQL // no-i18n
+                + DOWNLOADED_JOIN_SQL + THUMBNAIL_JOIN_SQL;
+    }
+    if (mDownloadsIndexed) {
+        return MESSAGE_COLUMNS_SQL + "file.path AS downloaded, NULL AS thumb " + MESSAGE_FROM_SQL + DOWNLOADED_JOIN_SQL; // no-i18n
+    }
+    return MESSAGE_COLUMNS_SQL + "NULL AS downloaded, NULL AS thumb " + MESSAGE_FROM_SQL; // no-i18n
+}
+
+void TelegramQuery::checkPlan(QString const &sql, QStringList const &allowed) {
+    if (!mSession->checksPlans()) return;
+
+    for (auto &scan: QueryPlan::fullScans(mDatabase, sql, allowed)) {
+        mSession->fullScan(sql, scan);
+    }
+}
+
+bool TelegramQuery::interrupted() {
+    if (!mCancelled) return false;
+
+    mInterrupted++;
+    return true;
 }
 
 void TelegramQuery::run(SearchReplyProxy const &reply) {
@@ -40,61 +197,276 @@ void TelegramQuery::run(SearchReplyProxy const &reply) {
     const QString searchQuery = QString::fromStdString(query().query_string());
     const bool isSearch = !searchQuery.isEmpty();
 
-    mOwnNumber = getPrimaryPhoneNumber();
-    if (mOwnNumber.isEmpty()) {
-        pushLogin(reply);
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!mPartOfMerge) {
+        const QStringList accounts = mSession->accounts();
+        if (accounts.isEmpty()) {
+            pushLogin(reply);
+            return;
+        }
+        if (accounts.size() > 1) {
+            runAccounts(reply, accounts, timer);
+            return;
+        }
+        mAccount = accounts.first();
+    }
+
+    // A part that stops before it needs categories still has to let the
+    // merging query go on.
+    struct MergeGuard {
+        TelegramQuery *query;
+        ~MergeGuard() { query->awaitCategories(0, false); }
+    } mergeGuard{this};
+
+    if (!mSession->acquire(mAccount, mOwnId, mDatabase, mCold)) {
+        if (!mPartOfMerge) pushLogin(reply);
         return;
     }
-    bool opened = openDatabase(mOwnNumber);
-    if (!opened) {
-        pushLogin(reply);
+    mOwnNumber = mAccount;
+    if (stopAt("start")) { // no-i18n
+        if (!mPartOfMerge) mSession->cancelled(mStoppedAt, mInterrupted, mDropped);
         return;
     }
 
-    mOwnId = getPrimaryUserId();
     if (mOwnId == 0) {
         if (mIsAggregated) return; // No results.
 
         QString title = N_("Failed to get Telegram data");
         QString subtitle = N_("Touch here to open app");
+        awaitCategories(0);
         pushError(reply, title, subtitle);
         return;
     }
 
     if (isSearch && mIsAggregated) return;
 
+    setHandle(mDatabase);
+    mDownloadsIndexed = mSession->hasIndex(SCOPE_INDEX_DOWNLOADS);
+    mThumbnailsIndexed = mSession->hasIndex(SCOPE_INDEX_THUMBNAILS);
+    mPeerSearchIndexed = mSession->hasIndex(SCOPE_INDEX_PEER_SEARCH);
+    mDialogsIndexed = mSession->hasIndex(SCOPE_INDEX_DIALOG_ORDER);
+    mRecentMediaIndexed = mSession->hasIndex(SCOPE_INDEX_RECENT_MEDIA);
+
+    ResultStream stream(reply, timer);
     if (isSearch) {
         // TODO: Should we allow Telegram messages search when aggregated?
         if (DEBUG) qDebug().noquote() << TAG << "search with limit:" << LIMIT_SEARCH;
-        processSearch(reply, searchQuery, LIMIT_SEARCH);
+        processSearch(reply, stream, searchQuery, LIMIT_SEARCH);
     } else {
         int limit = LIMIT_SURFACE;
         if (mInRecent) limit = 1;
         if (mInPhotos) limit = LIMIT_MEDIA;
 
-        if (DEBUG) qDebug().noquote() << TAG << "surfacing with limit:" << limit;
-        processDialogs(reply, searchQuery, limit);
+        // Served from the app's snapshot while it is current, the database
+        // is only read when it is missing, stale or too short.
+        mSnapshot = mSession->snapshot();
+        if (mSnapshot && !mSnapshot->covers(limit)) {
+            mSnapshot.reset();
+        }
+
+        if (DEBUG) qDebug().noquote() << TAG << "surfacing with limit:" << limit << (mSnapshot ? "from snapshot" : ""); // no-i18n
+        processDialogs(reply, stream, searchQuery, limit);
     }
-}
+    qDebug().noquote() << TAG << "returned" << stream.pushed() << "results"; // no-i18n
 
-inline bool TelegramQuery::aggregated(std::string keyword) {
-    auto keywords = mMetadata.aggregated_keywords();
-    return keywords.find(keyword) != keywords.end();
+    // The connection outlives this query, a late cancel must not reach
+    // whatever runs on it next.
+    setHandle(QSqlDatabase());
+    mSession->release();
+
+    // The merging query accounts for all of them.
+    if (mPartOfMerge) return;
+
+    if (mCancelled) {
+        mSession->cancelled(mStoppedAt, mInterrupted, mDropped);
+    } else {
+        mSession->report(mCold, mSnapshot != nullptr, timer.elapsed(), stream.firstCard());
+    }
 }
 
-bool TelegramQuery::openDatabase(QString const &number) {
-    const QString dbPath = DATABASE_PATH_FMT.arg(number);
+void TelegramQuery::runAccounts(SearchReplyProxy const &reply, QStringList const &accounts, QElapsedTimer const &timer) {
+    // One query per account on the thread pool, each with its own
+    // connection, collecting instead of pushing.
+    std::vector<std::unique_ptr<TelegramQuery>> parts;
+    std::vector<std::shared_ptr<CollectingReply>> replies;
+    std::vector<QFuture<void>> futures;
+    QSemaphore finished;
+    Merge merge;
+    for (auto &account: accounts) {
+        parts.emplace_back(new TelegramQuery(query(), mMetadata, mScopeDir, mSession, account));
+        replies.push_back(std::make_shared<CollectingReply>(reply));
+
+        TelegramQuery *part = parts.back().get();
+        part->mMerge = &merge;
+        {
+            QMutexLocker locker(&mHandleMutex);
+            mParts.push_back(part);
+            if (mCancelled) part->cancelled();
+        }
+        SearchReplyProxy partReply = replies.back();
+        futures.push_back(QtConcurrent::run([part, partReply, &finished]() {
+            part->run(partReply);
+            finished.release();
+        }));
+    }
 
-    QFile db(dbPath);
-    if (!db.exists()) {
-        qCritical() << "telegram db: file not found";
-        return false;
+    // All accounts share one budget; whatever is still running when it is
+    // used up is cancelled and contributes what it has collected so far.
+    // The categories are registered once every account has read its dialogs,
+    // for the unread total, and before any of them has a result.
+    const int count = int(parts.size());
+    auto cancelParts = [&parts]() {
+        for (auto &part: parts) {
+            part->cancelled();
+        }
+    };
+    bool inBudget = merge.dialogsRead.tryAcquire(count, qMax(0, ACCOUNTS_BUDGET - int(timer.elapsed())));
+    if (!inBudget) cancelParts();
+
+    const std::vector<std::string> order = registerMergedCategories(reply, !query().query_string().empty(), merge.unreadTotal);
+    merge.categoriesReady.release(count);
+
+    if (inBudget && !finished.tryAcquire(count, qMax(0, ACCOUNTS_BUDGET - int(timer.elapsed())))) {
+        inBudget = false;
+        cancelParts();
+    }
+    if (!inBudget) {
+        qDebug().noquote() << TAG << "accounts over budget after" << timer.elapsed() << "ms"; // no-i18n
+    }
+    for (auto &future: futures) {
+        future.waitForFinished();
+    }
+    {
+        QMutexLocker locker(&mHandleMutex);
+        mParts.clear();
+    }
+
+    if (mCancelled) {
+        mSession->cancelled("accounts", 0, 0); // no-i18n
+        return;
     }
 
-    mDatabase = QSqlDatabase::addDatabase("QSQLITE", "tg-data");
-    mDatabase.setDatabaseName(dbPath);
+    // Each account's results by category, in the order it pushed them.
+    std::map<std::string, std::vector<std::vector<CollectingReply::Collected const *>>> byId;
+    for (auto &id: order) {
+        byId[id].resize(parts.size());
+    }
+    bool cold = false;
+    bool fromSnapshot = true;
+    for (uint i = 0; i < parts.size(); i++) {
+        cold = cold || parts[i]->wasCold();
+        fromSnapshot = fromSnapshot && parts[i]->fromSnapshot();
+        for (auto &collected: replies[i]->results()) {
+            auto found = byId.find(collected.categoryId);
+            if (found != byId.end()) found->second[i].push_back(&collected);
+        }
+    }
 
-    return mDatabase.open();
+    // An account without results of its own only gets to show its error
+    // or placeholder when no other account has anything.
+    auto isPlaceholder = [](std::string const &id) {
+        return id == "error" || id == "empty"; // no-i18n
+    };
+    bool hasResults = false;
+    for (auto &id: order) {
+        if (isPlaceholder(id)) continue;
+        for (auto &part: byId[id]) {
+            if (!part.empty()) hasResults = true;
+        }
+    }
+
+    ResultStream stream(reply, timer);
+    for (auto &id: order) {
+        if (hasResults && isPlaceholder(id)) continue;
+        auto &collected = byId[id];
+
+        // Message cards go newest first, capped where each account capped
+        // its own. People and chats are interleaved in each account's order,
+        // once per peer even if several accounts know them.
+        std::vector<CollectingReply::Collected const *> merged;
+        size_t cap = 0;
+        bool dated = false;
+        for (auto &part: collected) {
+            cap = std::max(cap, part.size());
+            for (auto result: part) {
+                if (result->attrs.count("timestamp")) dated = true; // no-i18n
+            }
+        }
+        if (dated) {
+            for (auto &part: collected) {
+                for (auto result: part) {
+                    if (result->attrs.count("timestamp")) merged.push_back(result); // no-i18n
+                }
+            }
+            std::stable_sort(merged.begin(), merged.end(), [](CollectingReply::Collected const *a, CollectingReply::Collected const *b) {
+                return a->attrs.at("timestamp").get_int64_t() > b->attrs.at("timestamp").get_int64_t(); // no-i18n
+            });
+            if (merged.size() > cap) merged.resize(cap);
+        } else {
+            std::set<std::string> uris;
+            for (size_t row = 0; row < cap; row++) {
+                for (auto &part: collected) {
+                    if (row < part.size() && uris.insert(part[row]->uri).second) {
+                        merged.push_back(part[row]);
+                    }
+                }
+            }
+        }
+
+        auto category = reply->lookup_category(id);
+        for (auto result: merged) {
+            CategorisedResult copy(category);
+            for (auto &attribute: result->attrs) {
+                copy[attribute.first] = attribute.second;
+            }
+            copy.set_uri(result->uri);
+            if (!pushResult(stream, copy)) break;
+        }
+    }
+    qDebug().noquote() << TAG << "returned" << stream.pushed() << "results from" << parts.size() << "accounts"; // no-i18n
+
+    mSession->report(cold, fromSnapshot, timer.elapsed(), stream.firstCard());
+}
+
+std::vector<std::string> TelegramQuery::registerMergedCategories(SearchReplyProxy const &reply, bool isSearch, int unreadTotal) {
+    // Every category an account may push to, titled and ordered as run()
+    // registers them for a single account. The Dash leaves out the ones
+    // that stay empty.
+    std::vector<std::string> order;
+    auto add = [&reply, &order](std::string const &id, std::string const &title, std::string const &renderer) {
+        reply->register_category(id, title, "", CategoryRenderer(renderer));
+        order.push_back(id);
+    };
+    if (isSearch) {
+        add("users", N_("Results in: Contacts & Chats"), CONTACTS_SEARCH_TEMPLATE);
+        add("messages", N_("Results in: Messages"), MESSAGES_SEARCH_TEMPLATE);
+    } else if (mInPhotos) {
+        add("photos", "Telegram", PHOTO_MESSAGES_TEMPLATE); // no-i18n
+    } else {
+        if (!mInRecent) add("users", N_("People You Talk To"), CONTATS_TEMPLATE);
+        add("unread", unreadTitle(unreadTotal).toStdString(), UNREAD_MESSAGES_TEMPLATE);
+        add("recent", N_("Recent Chats"), RECENT_MESSAGES_TEMPLATE);
+        add("photos", N_("Recent Photos"), PHOTO_MESSAGES_TEMPLATE);
+    }
+    add("error", "", ERROR_TEMPLATE);
+    add("empty", "", LOGIN_TEMPLATE);
+    return order;
+}
+
+void TelegramQuery::awaitCategories(int unreadTotal, bool wait) {
+    if (!mMerge || mMergeJoined) return;
+
+    mMergeJoined = true;
+    mMerge->unreadTotal += unreadTotal;
+    mMerge->dialogsRead.release();
+    if (wait) mMerge->categoriesReady.acquire();
+}
+
+inline bool TelegramQuery::aggregated(std::string keyword) {
+    auto keywords = mMetadata.aggregated_keywords();
+    return keywords.find(keyword) != keywords.end();
 }
 
 QString TelegramQuery::getDate(qint64 time) {
@@ -108,72 +480,66 @@ QString TelegramQuery::getAvatar(QString scopePath, qint64 userId) {
     return QString("file://%1/user_%2.png").arg(scopePath).arg(image); // no-i18n
 }
 
-QString TelegramQuery::getPrimaryPhoneNumber() {
-    QString number;
-
-    QFile db(PROFILES_PATH);
-    if (!db.exists()) {
-        qCritical() << "profiles db: file not found";
-        return number;
-    }
-
-    QSqlDatabase profiles = QSqlDatabase::addDatabase("QSQLITE", "tg-profiles");
-    profiles.setDatabaseName(PROFILES_PATH);
-
-    if (!profiles.open()) {
-        qCritical() << "profiles db: failed to open";
-        return number;
-    }
-
-    QSqlQuery query(profiles);
-    query.prepare("SELECT number FROM Profiles ORDER BY rowid LIMIT 1");
-    if (!query.exec() || !query.first()) {
-        qCritical() << "profiles db: failed to query phone number";
-        return number;
+QString TelegramQuery::getPeerAvatar(qint64 peerId, QString const &photo) {
+    if (photo.isEmpty()) {
+        return getAvatar(mScopeDir, peerId);
     }
-
-    int numberIndex = query.record().indexOf("number");
-    number = query.value(numberIndex).toString();
-    profiles.close();
-
-    if (DEBUG) qDebug() << QString("primary profile: *%1").arg(number.mid(number.length() - 3, 3));
-
-    return number;
+    return QString(PROFILE_PATH_FMT).arg(mOwnNumber).arg(peerId).arg(photo);
 }
 
-qint64 TelegramQuery::getPrimaryUserId() {
-    qint64 userId = 0;
-    QString trimmedPhone = (mOwnNumber.at(0) == '+') ? mOwnNumber.mid(1) : mOwnNumber;
+void TelegramQuery::setMedia(Message &msg, QString const &photo, QString const &video, QString const &downloaded,
+                             QString const &thumb) {
+    qint64 dialogId = msg.isChat ? msg.chat.id : msg.user.id;
 
-    QSqlQuery query(mDatabase);
-    query.prepare("SELECT id FROM Users WHERE phone = :phone");
-    query.bindValue(":phone", trimmedPhone);
-    if (query.exec() && query.first()) {
-        userId = query.value(query.record().indexOf("id")).toInt();
-    }
+    // Set from the app's download index, see isDownloaded() for the rest.
+    msg.downloaded = !downloaded.isEmpty();
 
-    return userId;
+    switch (msg.mediaType) {
+    case MessageMedia::typeMessageMediaPhoto:
+        msg.mediaUrl = QString(PHOTO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(photo);
+        if (msg.downloaded) {
+            msg.mediaUrl = "file://" + downloaded; // no-i18n
+        }
+        msg.mediaThumb = thumb.isEmpty() ? msg.mediaUrl : "file://" + thumb; // no-i18n
+        if (DEBUG) qDebug() << "photo:" << msg.mediaUrl << "thumb:" << msg.mediaThumb;
+        break;
+    case MessageMedia::typeMessageMediaVideo:
+        msg.mediaUrl = QString(VIDEO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(video);
+        if (msg.downloaded) {
+            msg.mediaUrl = "file://" + downloaded; // no-i18n
+        }
+        msg.mediaThumb = QString(msg.mediaUrl) + ".jpg"; // no-i18n
+        if (DEBUG) qDebug() << "video:" << msg.mediaUrl;
+        if (DEBUG) qDebug() << "video thumb:" << msg.mediaThumb;
+        break;
+    case MessageMedia::typeMessageMediaEmpty:
+        break;
+    default:
+        qCritical() << "Unhandled media type!";
+        break;
+    }
 }
 
-void TelegramQuery::processSearch(SearchReplyProxy const &reply, const QString &searchQuery, int limit) {
+void TelegramQuery::processSearch(SearchReplyProxy const &reply, ResultStream &stream, const QString &searchQuery, int limit) {
     UserMap users;
     ChatMap chats;
-    ResultList results;
-
-    searchUsers(searchQuery, users);
-    searchChats(searchQuery, chats);
 
+    awaitCategories(0);
     CategoryRenderer contactsRenderer(CONTACTS_SEARCH_TEMPLATE);
     auto usersCategory = reply->register_category("users", N_("Results in: Contacts & Chats"), "", contactsRenderer);
+
+    searchUsers(searchQuery, users);
+    if (stopAt("search users")) return; // no-i18n
     for (auto &user: users) {
         if (user.first == mOwnId) continue;
 
-        auto result = userToResult(usersCategory, user.second);
-        results.push_back(result);
+        if (!pushResult(stream, userToResult(usersCategory, user.second))) return;
     }
+
+    searchChats(searchQuery, chats);
+    if (stopAt("search chats")) return; // no-i18n
     for (auto &chat: chats) {
-        auto result = chatToResult(usersCategory, chat.second);
-        results.push_back(result);
+        if (!pushResult(stream, chatToResult(usersCategory, chat.second))) return;
     }
 
     UserMap relatedUsers;
@@ -182,12 +548,15 @@ void TelegramQuery::processSearch(SearchReplyProxy const &reply, const QString &
 
     CategoryRenderer messagesRenderer(MESSAGES_SEARCH_TEMPLATE);
     auto messagesCategory = reply->register_category("messages", N_("Results in: Messages"), "", messagesRenderer);
-    QString relatedUids;
-    QString relatedCids;
+    IdList relatedUids;
+    IdList relatedCids;
     searchMessages(searchQuery, limit, messages, relatedUids, relatedCids);
+    if (stopAt("search messages")) return; // no-i18n
 
     getUsers(relatedUids, relatedUsers);
     getChats(relatedCids, relatedChats);
+    if (stopAt("related peers")) return; // no-i18n
+
     // Merge related users and chats with found messages.
     for (auto &message: messages) {
         if (message.isChat && relatedChats.find(message.chat.id) != relatedChats.end()) {
@@ -195,92 +564,54 @@ void TelegramQuery::processSearch(SearchReplyProxy const &reply, const QString &
         } else if (relatedUsers.find(message.user.id) != relatedUsers.end()) {
             message.user = relatedUsers.at(message.user.id);
         }
-        results.push_back(messageToResult(messagesCategory, message));
     }
+    pushMessages(stream, messagesCategory, messages, limit);
+}
 
-    for (auto &result: results) {
-        if (result["type"].get_string() != "unknown") { // no-i18n
-            if (!reply->push(result)) return;
-        }
-    }
+QString TelegramQuery::unreadTitle(int unreadTotal) {
+    // TRANSLATORS: Unread message count shown in the scope unread category.
+    QString newMessagesFormat = unreadTotal == 1 ? N_("%1 new message") : N_("%1 new messages");
+    // TRANSLATORS: The argument is a string saying how many new messages are there, like '5 new messages'.
+    QString newMessages = newMessagesFormat.arg(unreadTotal);
+    return QString(N_("Unread Chats (%1)")).arg(newMessages);
 }
 
-void TelegramQuery::processDialogs(SearchReplyProxy const &reply, const QString &searchQuery, uint limit) {
+void TelegramQuery::processDialogs(SearchReplyProxy const &reply, ResultStream &stream, const QString &searchQuery, uint limit) {
     const bool isSearch = !searchQuery.isEmpty();
 
-    QString dialogQuerySql = QString(
-        "SELECT peer, peerType, topMessage, unreadCount, "                           // no-i18n
-        "   (SELECT date FROM Messages WHERE messages.id = topMessage) AS date, "    // no-i18n
-        "   (SELECT id FROM Users WHERE users.id = peer) AS uid, "                   // no-i18n
-        "   (SELECT id FROM Chats WHERE chats.id = peer) AS cid "                    // no-i18n
-        "FROM dialogs WHERE encrypted = 0 ORDER BY date DESC LIMIT %1"               // no-i18n
-    ).arg(limit);
-
-    QSqlQuery query(mDatabase);
-    query.prepare(dialogQuerySql);
-    if (!query.exec()) {
-        qCritical() << "could not get top message data";
-        return;
-    }
-
-    QSqlRecord record = query.record();
-    QString uids;
-    QString cids;
-    QString unreadIds;
-    QString readIds;
+    IdList uids;
+    IdList cids;
+    IdList unreadIds;
+    IdList readIds;
     int unreadTotal = 0;
-    while (query.next()) {
-        QString peer = query.value(record.indexOf("peer")).toString();
-        qint32 type = (unsigned) query.value(record.indexOf("peerType")).toInt();
-        
-        if (PeerType::typePeerUser == static_cast<PeerType>(type)) {
-            // user
-            if (!uids.isEmpty()) uids += ",";
-            uids += peer;
-        } else {
-            // chat
-            if (!cids.isEmpty()) cids += ",";
-            cids += peer;
-        }
-
-        QString mid = query.value(record.indexOf("topMessage")).toString();
-        int unreadCount = query.value(record.indexOf("unreadCount")).toInt();
-
-        if (unreadCount > 0) {
-            if (!unreadIds.isEmpty()) unreadIds += ",";
-            unreadIds += mid;
-            unreadTotal += unreadCount;
-        } else {
-            if (!readIds.isEmpty()) readIds += ",";
-            readIds += mid;
-        }
-    }
 
     UserMap users;
     ChatMap chats;
     MessageList messages;
-    ResultList results;
 
-    CategoryRenderer photosRenderer(PHOTO_MESSAGES_TEMPLATE);
+    if (mSnapshot) {
+        getSnapshotDialogs(limit, uids, unreadIds, readIds, unreadTotal, users, chats);
+    } else {
+        if (!getDialogs(limit, uids, cids, unreadIds, readIds, unreadTotal)) return;
+        if (stopAt("dialogs")) return; // no-i18n
+
+        getUsers(uids, users);
+        getChats(cids, chats);
+        if (stopAt("peers")) return; // no-i18n
+    }
+    awaitCategories(unreadTotal);
 
-    getUsers(uids, users);
-    getChats(cids, chats);
+    CategoryRenderer photosRenderer(PHOTO_MESSAGES_TEMPLATE);
 
     if (mInPhotos) {
         // TODO Should photo aggregator respect the category title provided here? It currently does not.
         auto photoCategory = reply->register_category("photos", "Telegram", "", photosRenderer); // no-i18n
 
-        getMessages(users, chats, "", messages, true);
-        unsigned int messageCount = messages.size();
-        if (DEBUG) qDebug().noquote() << TAG << "returning" << messageCount << "results";
+        getMessages(users, chats, IdList(), messages, true);
+        if (stopAt("photos")) return; // no-i18n
+        if (DEBUG) qDebug().noquote() << TAG << "returning up to" << messages.size() << "results";
 
-        for (uint i = 0, resultCount = 0; i < messageCount && resultCount < limit; i++) {
-            auto result = messageToResult(photoCategory, messages[i]);
-            if (result["type"].get_string() != "unknown") {
-                if (!reply->push(result)) break;
-                resultCount++;
-            }
-        }
+        pushMessages(stream, photoCategory, messages, limit);
         return;
     }
 
@@ -288,180 +619,455 @@ void TelegramQuery::processDialogs(SearchReplyProxy const &reply, const QString
     CategoryRenderer unreadRenderer(UNREAD_MESSAGES_TEMPLATE);
     CategoryRenderer recentRenderer(isSearch ? MESSAGES_SEARCH_TEMPLATE : RECENT_MESSAGES_TEMPLATE);
 
-    auto usersCategory = reply->register_category("users", N_("People You Talk To"), "", contactsRenderer);
-    auto recentCategory = reply->register_category("recent", N_("Recent Chats"), "", recentRenderer);
-    auto photoCategory = reply->register_category("photos", N_("Recent Photos"), "", photosRenderer);
+    // Each category goes out as soon as its rows are read, always in this
+    // order: people, unread chats, recent chats, photos.
+    if (!mInRecent) {
+        auto usersCategory = reply->register_category("users", N_("People You Talk To"), "", contactsRenderer);
+
+        // Most recent conversation first.
+        for (qint64 uid: uids) {
+            if (uid == mOwnId || users.find(uid) == users.end()) continue;
+
+            if (!pushResult(stream, userToResult(usersCategory, users.at(uid)))) return;
+        }
+    }
 
     if (unreadTotal > 0) {
         // lists unread chats (not messages, as in v1), shows total unread count
-        // TRANSLATORS: Unread message count shown in the scope unread category.
-        QString newMessagesFormat = unreadTotal == 1 ? N_("%1 new message") : N_("%1 new messages");
-        // TRANSLATORS: The argument is a string saying how many new messages are there, like '5 new messages'.
-        QString newMessages = newMessagesFormat.arg(unreadTotal);
-        QString unreadTitle = QString(N_("Unread Chats (%1)")).arg(newMessages);
-        auto unreadCategory = reply->register_category("unread", unreadTitle.toStdString(), "", unreadRenderer);
+        auto unreadCategory = reply->register_category("unread", unreadTitle(unreadTotal).toStdString(), "", unreadRenderer);
 
         getMessages(users, chats, unreadIds, messages);
-        for (uint i = 0, resultCount = 0; i < messages.size() && resultCount < limit; i++) {
-            auto result = messageToResult(unreadCategory, messages[i]);
-            results.push_back(result);
-            resultCount++;
+        if (stopAt("unread")) return; // no-i18n
+
+        if (mInRecent && messages.size() > 0) {
+            if (stopAt("push")) return; // no-i18n
+            pushAggregatedResult(reply, messageToResult(unreadCategory, messages[0]));
+            return;
         }
+        if (!pushMessages(stream, unreadCategory, messages, limit)) return;
         messages.clear();
     }
 
-    if (mInRecent && results.size() > 0) {
-        pushAggregatedResult(reply, results[0]);
-        return;
-    }
-
     // recent read chats
+    auto recentCategory = reply->register_category("recent", N_("Recent Chats"), "", recentRenderer);
     getMessages(users, chats, readIds, messages);
-    for (uint i = 0, resultCount = 0; i < messages.size() && resultCount < limit; i++) {
-        auto result = messageToResult(recentCategory, messages[i]);
-        results.push_back(result);
-        resultCount++;
-    }
-    messages.clear();
+    if (stopAt("recent")) return; // no-i18n
 
     if (mInRecent) {
-        if (results.size() > 0) {
-            pushAggregatedResult(reply, results[0]);
+        if (stopAt("push")) return; // no-i18n
+        if (messages.size() > 0) {
+            pushAggregatedResult(reply, messageToResult(recentCategory, messages[0]));
         } else {
             pushNoMessagesToday(reply);
         }
         return;
     }
+    if (!pushMessages(stream, recentCategory, messages, limit)) return;
+    messages.clear();
 
     // last photos
-    getMessages(users, chats, "", messages, true);
-    for (uint i = 0, resultCount = 0; i < messages.size() && resultCount < limit; i++) {
-        auto result = messageToResult(photoCategory, messages[i]);
-        results.push_back(result);
-        resultCount++;
+    auto photoCategory = reply->register_category("photos", N_("Recent Photos"), "", photosRenderer);
+    getMessages(users, chats, IdList(), messages, true);
+    if (stopAt("photos")) return; // no-i18n
+    pushMessages(stream, photoCategory, messages, limit);
+}
+
+bool TelegramQuery::getDialogs(uint limit, IdList &uids, IdList &cids, IdList &unreadIds, IdList &readIds, int &unreadTotal) {
+    QString dialogQuerySql;
+    if (mDialogsIndexed) {
+        // The app keeps each dialog's top message date and the unread total
+        // up to date, both are read off an index.
+        dialogQuerySql =
+            "SELECT peer, peerType, topMessage, unreadCount "                           // no-i18n
+            "FROM Dialogs WHERE encrypted = 0 ORDER BY topMessageDate DESC LIMIT :limit"; // no-i18n
+        checkPlan(dialogQuerySql);
+
+        const QString statsSql = "SELECT unreadTotal FROM DialogStats WHERE id = 0"; // no-i18n
+        checkPlan(statsSql);
+        QSqlQuery *stats = mSession->statement(statsSql);
+        if (!stats || !stats->exec() || !stats->next()) {
+            if (interrupted()) return false;
+            qCritical() << "could not get unread total";
+            return false;
+        }
+        unreadTotal = stats->value(0).toInt();
+        stats->finish();
+    } else {
+        // Databases the app has not upgraded yet: Dialogs is scanned as a
+        // whole and joined to Messages for the order.
+        dialogQuerySql =
+            "SELECT peer, peerType, topMessage, unreadCount, messages.date AS date "    // no-i18n
+            "FROM Dialogs LEFT JOIN Messages ON messages.id = topMessage "              // no-i18n
+            "WHERE encrypted = 0 ORDER BY date DESC LIMIT :limit";                      // no-i18n
+        checkPlan(dialogQuerySql, QStringList() << "Dialogs"); // no-i18n
     }
-    messages.clear();
 
-    // recent users
-    for (auto &user: users) {
-        if (user.first == mOwnId) continue;
+    QSqlQuery *query = mSession->statement(dialogQuerySql);
+    if (query) {
+        query->bindValue(":limit", limit);
+    }
+    if (!query || !query->exec()) {
+        if (interrupted()) return false;
+        qCritical() << "could not get top message data";
+        return false;
+    }
+
+    QSqlRecord record = query->record();
+    while (query->next()) {
+        qint64 peer = query->value(record.indexOf("peer")).toLongLong();
+        qint32 type = (unsigned) query->value(record.indexOf("peerType")).toInt();
+
+        if (PeerType::typePeerUser == static_cast<PeerType>(type)) {
+            // user
+            uids.push_back(peer);
+        } else {
+            // chat
+            cids.push_back(peer);
+        }
+
+        qint64 mid = query->value(record.indexOf("topMessage")).toLongLong();
+        int unreadCount = query->value(record.indexOf("unreadCount")).toInt();
 
-        auto result = userToResult(usersCategory, user.second);
-        results.insert(results.begin(), result);
+        if (unreadCount > 0) {
+            unreadIds.push_back(mid);
+            if (!mDialogsIndexed) unreadTotal += unreadCount;
+        } else {
+            readIds.push_back(mid);
+        }
     }
-    qDebug().noquote() << TAG << "returning" << results.size() << "results";
-    push(reply, results);
+    query->finish();
+
+    return true;
 }
 
-void TelegramQuery::queryUsers(const QString &sql, UserMap &users) {
-    QSqlQuery query(mDatabase);
-    query.prepare(sql);
-    if (!query.exec()) {
+void TelegramQuery::getSnapshotDialogs(uint limit, IdList &uids, IdList &unreadIds, IdList &readIds, int &unreadTotal,
+                                       UserMap &users, ChatMap &chats) {
+    using namespace SurfacingSnapshot;
+
+    // Same picks as getDialogs() and getUsers()/getChats(): dialogs in
+    // order, peers only when their row was found.
+    for (uint i = 0; i < mSnapshot->dialogCount() && i < limit; i++) {
+        const Entry &entry = mSnapshot->dialog(i);
+        const Message msg = snapshotMessage(entry);
+
+        if (entry.flags & EntryChat) {
+            if (entry.flags & EntryPeer) chats[msg.chat.id] = msg.chat;
+        } else {
+            uids.push_back(entry.peerId);
+            if (entry.flags & EntryPeer) users[msg.user.id] = msg.user;
+        }
+
+        if (entry.unreadCount > 0) {
+            unreadIds.push_back(entry.messageId);
+        } else {
+            readIds.push_back(entry.messageId);
+        }
+    }
+    unreadTotal = mSnapshot->unreadTotal();
+}
+
+void TelegramQuery::getSnapshotMessages(const IdList &mids, MessageList &messages, bool hasMedia) {
+    using namespace SurfacingSnapshot;
+
+    // Mirrors the filters and limits of the SQL in getMessages(); entries
+    // are already newest first.
+    qint64 start = 0;
+    qint64 end = 0;
+    uint limit = UINT_MAX;
+    if (mInRecent) {
+        const QDate today = QDate::currentDate();
+        start = QDateTime(today, QTime(0, 0, 0)).toTime_t();
+        end = QDateTime(today, QTime(23, 59, 59)).toTime_t();
+        limit = 1;
+    } else if (hasMedia && !mInPhotos) {
+        limit = LIMIT_MEDIA;
+    }
+
+    const std::set<qint64> wanted(mids.begin(), mids.end());
+    const uint count = hasMedia ? mSnapshot->photoCount() : mSnapshot->dialogCount();
+    for (uint i = 0; i < count && messages.size() < limit; i++) {
+        const Entry &entry = hasMedia ? mSnapshot->photo(i) : mSnapshot->dialog(i);
+        if (!(entry.flags & EntryMessage)) continue;
+        if (!hasMedia && wanted.find(entry.messageId) == wanted.end()) continue;
+        if (mInRecent && (entry.date < start || entry.date > end)) continue;
+
+        messages.push_back(snapshotMessage(entry));
+    }
+}
+
+Message TelegramQuery::snapshotMessage(SurfacingSnapshot::Entry const &entry) {
+    using namespace SurfacingSnapshot;
+
+    Message msg;
+    msg.id = entry.messageId;
+    msg.isChat = entry.flags & EntryChat;
+    if (msg.isChat) {
+        msg.chat.id = entry.peerId;
+        msg.chat.title = mSnapshot->string(entry.firstName);
+        msg.chat.avatar = getPeerAvatar(entry.peerId, mSnapshot->string(entry.avatar));
+    } else {
+        msg.user.id = entry.peerId;
+        msg.user.firstName = mSnapshot->string(entry.firstName);
+        msg.user.lastName = mSnapshot->string(entry.lastName);
+        msg.user.phone = mSnapshot->string(entry.phone);
+        msg.user.avatar = getPeerAvatar(entry.peerId, mSnapshot->string(entry.avatar));
+    }
+
+    msg.date = entry.date;
+    msg.isOut = entry.flags & EntryOut;
+    msg.isUnread = entry.flags & EntryUnread;
+    msg.text = mSnapshot->string(entry.text);
+    msg.mediaType = static_cast<MessageMedia>(entry.mediaType);
+    if (entry.flags & EntryMessage) {
+        setMedia(msg, mSnapshot->string(entry.photo), mSnapshot->string(entry.video), mSnapshot->string(entry.file),
+                 mSnapshot->string(entry.thumb));
+    }
+    return msg;
+}
+
+bool TelegramQuery::pushResult(ResultStream &stream, CategorisedResult const &result) {
+    if (stopAt("push")) { // no-i18n
+        mDropped++;
+        return false;
+    }
+    return stream.push(result);
+}
+
+bool TelegramQuery::pushMessages(ResultStream &stream, Category::SCPtr category, MessageList const &messages, uint limit) {
+    uint resultCount = 0;
+    for (uint i = 0; i < messages.size() && resultCount < limit; i++) {
+        if (stopAt("push")) { // no-i18n
+            mDropped += messages.size() - i;
+            return false;
+        }
+
+        auto result = messageToResult(category, messages[i]);
+        if (result["type"].get_string() == "unknown") continue; // no-i18n
+
+        if (!stream.push(result)) return false;
+        resultCount++;
+    }
+    return true;
+}
+
+void TelegramQuery::queryUsers(QSqlQuery *query, UserMap &users) {
+    if (!query || !query->exec()) {
+        if (interrupted()) return;
         qCritical() << "Could not get users";
         return;
     }
 
-    QSqlRecord record = query.record();
-    while (query.next()) {
+    QSqlRecord record = query->record();
+    while (query->next()) {
         User user;
-        user.id = query.value(record.indexOf("id")).toInt();
+        user.id = query->value(record.indexOf("id")).toInt();
         if (user.id == 0) {
             user.id = mOwnId;
         }
-        user.phone = query.value(record.indexOf("phone")).toString();
-        user.firstName = query.value(record.indexOf("firstName")).toString();
-        user.lastName = query.value(record.indexOf("lastName")).toString();
-
-        qint64 volumeId = query.value(record.indexOf("photoSmallVolumeId")).toInt();
-        qint64 localId = query.value(record.indexOf("photoSmallLocalId")).toInt();
-        if (volumeId == 0 && localId == 0) {
-            user.avatar = getAvatar(mScopeDir, user.id);
-        } else {
-            QString userThumb = QString("%1_%2").arg(volumeId).arg(localId); // no-i18n
-            user.avatar = QString(PROFILE_PATH_FMT).arg(mOwnNumber).arg(user.id).arg(userThumb);
+        user.phone = query->value(record.indexOf("phone")).toString();
+        user.firstName = query->value(record.indexOf("firstName")).toString();
+        user.lastName = query->value(record.indexOf("lastName")).toString();
+
+        qint64 volumeId = query->value(record.indexOf("photoSmallVolumeId")).toInt();
+        qint64 localId = query->value(record.indexOf("photoSmallLocalId")).toInt();
+        QString userThumb;
+        if (volumeId != 0 || localId != 0) {
+            userThumb = QString("%1_%2").arg(volumeId).arg(localId); // no-i18n
         }
+        user.avatar = getPeerAvatar(user.id, userThumb);
         if (DEBUG) qDebug() << user.avatar;
 
         users[user.id] = user;
     }
+    query->finish();
+}
+
+void TelegramQuery::getUsers(const IdList &ids, UserMap &users) {
+    for (uint from = 0; from < ids.size(); from += MAX_ID_SLOTS) {
+        const int slots = idSlots(ids.size() - from);
+        const QString sql = QString(
+            "SELECT id, phone, firstName, lastName, photoSmallVolumeId, photoSmallLocalId FROM Users WHERE id IN (%1)" // no-i18n
+        ).arg(idPlaceholders(slots));
+        checkPlan(sql);
+
+        QSqlQuery *query = mSession->statement(sql);
+        if (query) {
+            bindIds(query, ids, from, slots);
+        }
+        queryUsers(query, users);
+    }
 }
 
-void TelegramQuery::getUsers(const QString &ids, UserMap &users) {
-    QString sql = QString(
-        "SELECT id, phone, firstName, lastName, photoSmallVolumeId, photoSmallLocalId FROM Users WHERE id IN (%1)" // no-i18n
-    ).arg(ids);
-    queryUsers(sql, users);
+// Peers with a name word starting with the longest query word, a range seek
+// on PeerSearchKeys. Peers the app has not indexed since they changed are
+// all candidates; the caller checks every word against the names it reads.
+QString TelegramQuery::peerSearchSql(PeerType type) {
+    return QString(
+        "SELECT peer FROM PeerSearchKeys WHERE peerType = %1 AND key >= :from AND key < :to " // no-i18n
+        "UNION ALL SELECT peer FROM PeerSearchPending WHERE peerType = %1"                     // no-i18n
+    ).arg((unsigned int)type);
+}
+
+void TelegramQuery::bindPeerSearch(QSqlQuery *query, QStringList const &words) {
+    if (!query) return;
+
+    QString longest;
+    for (auto &word: words) {
+        if (word.size() > longest.size()) longest = word;
+    }
+    query->bindValue(":from", longest);
+    query->bindValue(":to", SearchKeys::prefixEnd(longest));
 }
 
 void TelegramQuery::searchUsers(const QString &searchQuery, UserMap &users) {
-    QString sql = QString(
+    if (mPeerSearchIndexed) {
+        const QStringList words = SearchKeys::keys(searchQuery);
+        if (words.isEmpty()) return;
+
+        QSqlQuery *query = mSession->statement(QString(
+            "SELECT id, phone, firstName, lastName, photoSmallVolumeId, photoSmallLocalId FROM Users " // no-i18n
+            "WHERE id IN (%1)"                                                                          // no-i18n
+        ).arg(peerSearchSql(PeerType::typePeerUser)));
+        bindPeerSearch(query, words);
+        queryUsers(query, users);
+
+        for (auto it = users.begin(); it != users.end();) {
+            if (SearchKeys::matches(words, it->second.firstName + " " + it->second.lastName)) {
+                ++it;
+            } else {
+                it = users.erase(it);
+            }
+        }
+        return;
+    }
+
+    QSqlQuery *query = mSession->statement(
         "SELECT id, phone, firstName, lastName, photoSmallVolumeId, photoSmallLocalId "  // no-i18n
-        "FROM Users WHERE firstName || ' ' || lastName LIKE '%%1%'"                      // no-i18n
-    ).arg(searchQuery);
-    queryUsers(sql, users);
+        "FROM Users WHERE firstName || ' ' || lastName LIKE :pattern ESCAPE '\\'"        // no-i18n
+    );
+    if (query) {
+        query->bindValue(":pattern", likePattern(searchQuery));
+    }
+    queryUsers(query, users);
 }
 
-void TelegramQuery::queryChats(const QString &sql, ChatMap &chats) {
-    QSqlQuery query(mDatabase);
-    query.prepare(sql);
-    if (!query.exec()) {
+void TelegramQuery::queryChats(QSqlQuery *query, ChatMap &chats) {
+    if (!query || !query->exec()) {
+        if (interrupted()) return;
         qCritical() << "Could not get chats";
         return;
     }
 
-    QSqlRecord record = query.record();
-    while (query.next()) {
+    QSqlRecord record = query->record();
+    while (query->next()) {
         Chat chat;
-        chat.id = query.value(record.indexOf("id")).toInt();
-        chat.title = query.value(record.indexOf("title")).toString();
-
-        qint64 volumeId = query.value(record.indexOf("photoSmallVolumeId")).toInt();
-        qint64 localId = query.value(record.indexOf("photoSmallLocalId")).toInt();
-        if (volumeId == 0 && localId == 0) {
-            chat.avatar = getAvatar(mScopeDir, chat.id);
-        } else {
-            QString chatThumb = QString("%1_%2").arg(volumeId).arg(localId); // no-i18n
-            chat.avatar = QString(PROFILE_PATH_FMT).arg(mOwnNumber).arg(chat.id).arg(chatThumb);
+        chat.id = query->value(record.indexOf("id")).toInt();
+        chat.title = query->value(record.indexOf("title")).toString();
+
+        qint64 volumeId = query->value(record.indexOf("photoSmallVolumeId")).toInt();
+        qint64 localId = query->value(record.indexOf("photoSmallLocalId")).toInt();
+        QString chatThumb;
+        if (volumeId != 0 || localId != 0) {
+            chatThumb = QString("%1_%2").arg(volumeId).arg(localId); // no-i18n
         }
+        chat.avatar = getPeerAvatar(chat.id, chatThumb);
 
         chats[chat.id] = chat;
     }
+    query->finish();
 }
 
-void TelegramQuery::getChats(const QString &ids, ChatMap &chats) {
-    QString sql = QString(
-        "SELECT id, title, photoSmallVolumeId, photoSmallLocalId FROM Chats WHERE id IN (%1)" // no-i18n
-    ).arg(ids);
-    queryChats(sql, chats);
+void TelegramQuery::getChats(const IdList &ids, ChatMap &chats) {
+    for (uint from = 0; from < ids.size(); from += MAX_ID_SLOTS) {
+        const int slots = idSlots(ids.size() - from);
+        const QString sql = QString(
+            "SELECT id, title, photoSmallVolumeId, photoSmallLocalId FROM Chats WHERE id IN (%1)" // no-i18n
+        ).arg(idPlaceholders(slots));
+        checkPlan(sql);
+
+        QSqlQuery *query = mSession->statement(sql);
+        if (query) {
+            bindIds(query, ids, from, slots);
+        }
+        queryChats(query, chats);
+    }
 }
 
 void TelegramQuery::searchChats(const QString &searchQuery, ChatMap &chats) {
-    QString sql = QString(
-        "SELECT id, title, photoSmallVolumeId, photoSmallLocalId FROM Chats WHERE title LIKE '%%1%'" // no-i18n
-    ).arg(searchQuery);
-    queryChats(sql, chats);
+    if (mPeerSearchIndexed) {
+        const QStringList words = SearchKeys::keys(searchQuery);
+        if (words.isEmpty()) return;
+
+        QSqlQuery *query = mSession->statement(QString(
+            "SELECT id, title, photoSmallVolumeId, photoSmallLocalId FROM Chats WHERE id IN (%1)" // no-i18n
+        ).arg(peerSearchSql(PeerType::typePeerChat)));
+        bindPeerSearch(query, words);
+        queryChats(query, chats);
+
+        for (auto it = chats.begin(); it != chats.end();) {
+            if (SearchKeys::matches(words, it->second.title)) {
+                ++it;
+            } else {
+                it = chats.erase(it);
+            }
+        }
+        return;
+    }
+
+    QSqlQuery *query = mSession->statement(
+        "SELECT id, title, photoSmallVolumeId, photoSmallLocalId FROM Chats WHERE title LIKE :pattern ESCAPE '\\'" // no-i18n
+    );
+    if (query) {
+        query->bindValue(":pattern", likePattern(searchQuery));
+    }
+    queryChats(query, chats);
 }
 
-void TelegramQuery::getMessages(const UserMap &users, const ChatMap &chats, const QString mids, MessageList &messages, bool hasMedia) {
-    QString whereSql = " WHERE "; // no-i18n
-    int limit = 0;
+void TelegramQuery::getMessages(const UserMap &users, const ChatMap &chats, const IdList &mids, MessageList &messages, bool hasMedia) {
+    // Without ids or media there is nothing to narrow the query down to.
+    if (mids.empty() && !hasMedia) return;
+
+    if (mSnapshot) {
+        getSnapshotMessages(mids, messages, hasMedia);
+        return;
+    }
+
+    QString selectSql = messageSelectSql();
+    QString whereSql = "WHERE "; // no-i18n
+    QString orderSql = "ORDER BY mdate DESC "; // no-i18n
+    QStringList allowedScans;
+    int limit = -1;
 
     if (mInRecent) {
         // clam date column to results from today and LIMIT 1
-        const QDate today = QDate::currentDate();//QDateTime::currentDateTime().toLocalTime().date();
-        const QDateTime todayStart(today, QTime(0, 0, 0));
-        const QDateTime todayEnd(today, QTime(23, 59, 59));
-        whereSql += QString("mdate BETWEEN %1 AND %2 ").arg(todayStart.toTime_t()).arg(todayEnd.toTime_t()); // no-i18n
+        whereSql += "mdate BETWEEN :start AND :end "; // no-i18n
         limit = 1;
     } else {
         whereSql += "1=1 "; // no-i18n
     }
 
-    if (!mids.isEmpty()) {
-        whereSql += QString("AND mid IN (%1)").arg(mids); // no-i18n
+    int slots = 0;
+    if (!mids.empty()) {
+        // Top messages of the listed dialogs, never more than the surface limit.
+        slots = idSlots(mids.size());
+        whereSql += QString("AND mid IN (%1) ").arg(idPlaceholders(slots)); // no-i18n
+    } else if (hasMedia && mRecentMediaIndexed) {
+        // Only downloaded photos are shown, so the limit holds for the
+        // aggregator as well.
+        selectSql = RECENT_MEDIA_SQL;
+        whereSql += "AND recent.mediaType = :mediaType AND file.path IS NOT NULL "; // no-i18n
+        orderSql = "ORDER BY recent.date DESC "; // no-i18n
+        allowedScans << "RecentMedia"; // no-i18n
+        if (!mInRecent) {
+            limit = LIMIT_MEDIA;
+        }
     } else if (hasMedia) {
-        whereSql += QString("AND mediaType IN (%1)") // no-i18n
-                .arg((unsigned int)MessageMedia::typeMessageMediaPhoto);
+        whereSql += "AND mediaType = :mediaType "; // no-i18n
+        if (mDownloadsIndexed) {
+            // Photos that were never downloaded are skipped here rather than
+            // after a stat() each, which matters without a limit.
+            whereSql += "AND file.path IS NOT NULL "; // no-i18n
+        }
 
         /*
         whereSql += QString("WHERE mediaType IN (%1,%2)") // no-i18n
@@ -473,30 +1079,41 @@ void TelegramQuery::getMessages(const UserMap &users, const ChatMap &chats, cons
         }
     }
 
-    QString limitSql = (limit > 0) ? QString("LIMIT %1").arg(limit) : " ";
-
-    QString sql = QString(
-        "SELECT messages.id as mid, messages.date as mdate, out, unread, toPeerType, mediaType, mediaVideo as vid, message, fromId, toId, " // no-i18n
-        "   (SELECT locationVolumeId || '_' || locationLocalId FROM photoSizes WHERE mediaPhoto = pid LIMIT 1) AS photo, "                  // no-i18n
-        "   (SELECT locationVolumeId || '_' || locationLocalId FROM photoSizes WHERE mediaVideo = pid LIMIT 1) AS video "                   // no-i18n
-        "FROM Messages %1 ORDER BY mdate DESC %2"                                                                                           // no-i18n
-    ).arg(whereSql).arg(limitSql);
-
-    QSqlQuery query(mDatabase);
-    query.prepare(sql);
-    if (!query.exec()) {
+    const QString sql = selectSql + whereSql + orderSql + "LIMIT :limit"; // no-i18n
+    checkPlan(sql, allowedScans);
+
+    QSqlQuery *query = mSession->statement(sql);
+    if (query) {
+        if (mInRecent) {
+            const QDate today = QDate::currentDate();//QDateTime::currentDateTime().toLocalTime().date();
+            const QDateTime todayStart(today, QTime(0, 0, 0));
+            const QDateTime todayEnd(today, QTime(23, 59, 59));
+            query->bindValue(":start", todayStart.toTime_t());
+            query->bindValue(":end", todayEnd.toTime_t());
+        }
+        if (slots > 0) {
+            bindIds(query, mids, 0, slots);
+        } else {
+            query->bindValue(":mediaType", (unsigned int)MessageMedia::typeMessageMediaPhoto);
+        }
+        // A negative limit means no limit to SQLite.
+        query->bindValue(":limit", limit);
+    }
+    if (!query || !query->exec()) {
+        if (interrupted()) return;
         qCritical() << "Could not get messages";
+        return;
     }
 
-    while (query.next()) {
-        const QSqlRecord &record = query.record();
+    while (query->next()) {
+        const QSqlRecord &record = query->record();
 
         Message msg;
-        msg.id = query.value(record.indexOf("mid")).toInt();
+        msg.id = query->value(record.indexOf("mid")).toInt();
 
-        qint32 toPeerType = (unsigned int) query.value(record.indexOf("toPeerType")).toInt();
+        qint32 toPeerType = (unsigned int) query->value(record.indexOf("toPeerType")).toInt();
         msg.isChat = (PeerType::typePeerChat == static_cast<PeerType>(toPeerType));
-        qint64 toId = query.value(record.indexOf("toId")).toInt();;
+        qint64 toId = query->value(record.indexOf("toId")).toInt();;
         if (msg.isChat) {
             if (chats.find(toId) != chats.end()) {
                 msg.chat = chats.at(toId);
@@ -504,7 +1121,7 @@ void TelegramQuery::getMessages(const UserMap &users, const ChatMap &chats, cons
                 qCritical() << "chat not found: " << toId;
             }
         }
-        qint64 fromId = query.value(record.indexOf("fromId")).toInt();;
+        qint64 fromId = query->value(record.indexOf("fromId")).toInt();;
         qint64 userId = (fromId == mOwnId) ? toId : fromId;
         if (users.find(userId) != users.end()) {
             msg.user = users.at(userId);
@@ -512,114 +1129,119 @@ void TelegramQuery::getMessages(const UserMap &users, const ChatMap &chats, cons
             qCritical().noquote() << TAG << "user not found" << fromId;
         }
 
-        msg.date = query.value(record.indexOf("mdate")).toInt();
-        msg.isOut = query.value(record.indexOf("out")).toBool();
-        msg.isUnread = query.value(record.indexOf("unread")).toBool();
+        msg.date = query->value(record.indexOf("mdate")).toInt();
+        msg.isOut = query->value(record.indexOf("out")).toBool();
+        msg.isUnread = query->value(record.indexOf("unread")).toBool();
 
-        msg.text = query.value(record.indexOf("message")).toString();
-        msg.mediaType = static_cast<MessageMedia>(query.value(record.indexOf("mediaType")).toInt());
+        msg.text = query->value(record.indexOf("message")).toString();
+        msg.mediaType = static_cast<MessageMedia>(query->value(record.indexOf("mediaType")).toInt());
 
-        qint64 dialogId = msg.isChat ? msg.chat.id : msg.user.id;
+        setMedia(msg, query->value(record.indexOf("photo")).toString(), query->value(record.indexOf("vid")).toString(),
+                 query->value(record.indexOf("downloaded")).toString(), query->value(record.indexOf("thumb")).toString());
 
-        switch (msg.mediaType) {
-        case MessageMedia::typeMessageMediaPhoto: {
-            QString photo = query.value(record.indexOf("photo")).toString();
-            msg.mediaUrl = QString(PHOTO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(photo);
-            msg.mediaThumb = msg.mediaUrl;
-            if (DEBUG) qDebug() << "photo:" << msg.mediaUrl;
-            break;
+        messages.push_back(msg);
+    }
+    query->finish();
+}
+
+void TelegramQuery::searchMessages(const QString searchQuery, int limit, MessageList &messages, IdList &relatedUids, IdList &relatedCids) {
+    MessageIndex index(*mSession);
+    MessageHitList hits;
+    if (index.isAvailable() && index.search(searchQuery, limit, hits)) {
+        if (hits.empty()) return;
+        if (stopAt("message index")) return; // no-i18n
+
+        IdList ids;
+        for (auto &hit: hits) {
+            ids.push_back(hit.id);
         }
-        case MessageMedia::typeMessageMediaVideo: {
-            QString video = query.value(record.indexOf("vid")).toString();
-            msg.mediaUrl = QString(VIDEO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(video);
-            msg.mediaThumb = QString(msg.mediaUrl) + ".jpg"; // no-i18n
-            if (DEBUG) qDebug() << "video:" << msg.mediaUrl;
-            if (DEBUG) qDebug() << "video thumb:" << msg.mediaThumb;
-            break;
+
+        const int slots = idSlots(ids.size());
+        const QString sql = messageSelectSql() + QString("WHERE messages.id IN (%1)").arg(idPlaceholders(slots)); // no-i18n
+        checkPlan(sql);
+
+        QSqlQuery *query = mSession->statement(sql);
+        if (query) {
+            bindIds(query, ids, 0, slots);
         }
-        case MessageMedia::typeMessageMediaEmpty: 
-            break;
-        default:
-            qCritical() << "Unhandled media type!";
-            break;
+
+        MessageList found;
+        queryFoundMessages(query, found, relatedUids, relatedCids);
+
+        // Keep the ranking of the index, show the excerpt on the card and the
+        // highlighted message in the preview.
+        std::map<qint64, Message> byId;
+        for (auto &msg: found) {
+            byId[msg.id] = msg;
+        }
+        for (auto &hit: hits) {
+            auto it = byId.find(hit.id);
+            if (it == byId.end()) continue;
+
+            Message msg = it->second;
+            msg.text = hit.snippet;
+            msg.highlighted = hit.highlighted;
+            messages.push_back(msg);
         }
+        return;
+    }
+    // A failed index search may just have been interrupted.
+    if (stopAt("message index")) return; // no-i18n
 
-        messages.push_back(msg);
+    QSqlQuery *query = mSession->statement(messageSelectSql() + "WHERE message LIKE :pattern ESCAPE '\\' ORDER BY mdate DESC LIMIT :limit"); // no-i18n
+    if (query) {
+        query->bindValue(":pattern", likePattern(searchQuery));
+        query->bindValue(":limit", limit);
     }
+    queryFoundMessages(query, messages, relatedUids, relatedCids);
 }
 
-void TelegramQuery::searchMessages(const QString searchQuery, int limit, MessageList &messages, QString &relatedUids, QString &relatedCids) {
-    QString sql = QString(
-        "SELECT messages.id as mid, messages.date as mdate, out, unread, toPeerType, mediaType, mediaVideo as vid, message, fromId, toId, " // no-i18n
-        "   (SELECT locationVolumeId || '_' || locationLocalId FROM photoSizes WHERE mediaPhoto = pid LIMIT 1) AS photo, "                  // no-i18n
-        "   (SELECT locationVolumeId || '_' || locationLocalId FROM photoSizes WHERE mediaVideo = pid LIMIT 1) AS video "                   // no-i18n
-        "FROM Messages WHERE message LIKE '%%1%' ORDER BY mdate DESC LIMIT %2"                                                              // no-i18n
-    ).arg(searchQuery).arg(limit);
-
-    QSqlQuery query(mDatabase);
-    query.prepare(sql);
-    if (!query.exec()) {
+void TelegramQuery::queryFoundMessages(QSqlQuery *query, MessageList &messages, IdList &relatedUids, IdList &relatedCids) {
+    if (!query || !query->exec()) {
+        if (interrupted()) return;
         qCritical() << "Could not get messages";
+        return;
     }
 
-    while (query.next()) {
-        const QSqlRecord &record = query.record();
+    while (query->next()) {
+        const QSqlRecord &record = query->record();
 
         Message msg;
-        msg.id = query.value(record.indexOf("mid")).toInt();
+        msg.id = query->value(record.indexOf("mid")).toInt();
 
-        qint32 toPeerType = (unsigned int) query.value(record.indexOf("toPeerType")).toInt();
+        qint32 toPeerType = (unsigned int) query->value(record.indexOf("toPeerType")).toInt();
         msg.isChat = (PeerType::typePeerChat == static_cast<PeerType>(toPeerType));
-        qint64 toId = query.value(record.indexOf("toId")).toInt();;
+        qint64 toId = query->value(record.indexOf("toId")).toInt();;
         if (msg.isChat) {
             msg.chat.id = toId;
-            if (!relatedCids.isEmpty()) relatedCids += ",";
-            relatedCids += QString::number(toId);
+            relatedCids.push_back(toId);
         }
-        qint64 fromId = query.value(record.indexOf("fromId")).toInt();;
+        qint64 fromId = query->value(record.indexOf("fromId")).toInt();;
         qint64 userId = (fromId == mOwnId) ? toId : fromId;
-        if (!relatedUids.isEmpty()) relatedUids += ",";
-        relatedUids += QString::number(userId);
+        relatedUids.push_back(userId);
         msg.user.id = userId;
 
-        msg.date = query.value(record.indexOf("mdate")).toInt();
-        msg.isOut = query.value(record.indexOf("out")).toBool();
-        msg.isUnread = query.value(record.indexOf("unread")).toBool();
+        msg.date = query->value(record.indexOf("mdate")).toInt();
+        msg.isOut = query->value(record.indexOf("out")).toBool();
+        msg.isUnread = query->value(record.indexOf("unread")).toBool();
 
-        msg.text = query.value(record.indexOf("message")).toString();
-        msg.mediaType = static_cast<MessageMedia>(query.value(record.indexOf("mediaType")).toInt());
+        msg.text = query->value(record.indexOf("message")).toString();
+        msg.mediaType = static_cast<MessageMedia>(query->value(record.indexOf("mediaType")).toInt());
 
-        qint64 dialogId = msg.isChat ? msg.chat.id : msg.user.id;
-
-        switch (msg.mediaType) {
-        case MessageMedia::typeMessageMediaPhoto: {
-            QString photo = query.value(record.indexOf("photo")).toString();
-            msg.mediaUrl = QString(PHOTO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(photo);
-            msg.mediaThumb = msg.mediaUrl;
-            if (DEBUG) qDebug() << "photo:" << msg.mediaUrl;
-            break;
-        }
-        case MessageMedia::typeMessageMediaVideo: {
-            QString video = query.value(record.indexOf("vid")).toString();
-            msg.mediaUrl = QString(VIDEO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(video);
-
-            // TODO verify this works for non-downloaded
-
-            // msg.mediaThumb = QString(PHOTO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(videoThumb);
-            msg.mediaThumb = QString(VIDEO_PATH_FMT).arg(mOwnNumber).arg(dialogId).arg(video) + ".jpg";
-            if (DEBUG) qDebug() << "video:" << msg.mediaUrl;
-            if (DEBUG) qDebug() << "video thumb:" << msg.mediaThumb;
-            break;
-        }
-        case MessageMedia::typeMessageMediaEmpty: 
-            break;
-        default:
-            qCritical() << "Unhandled media type!";
-            break;
-        }
+        setMedia(msg, query->value(record.indexOf("photo")).toString(), query->value(record.indexOf("vid")).toString(),
+                 query->value(record.indexOf("downloaded")).toString(), query->value(record.indexOf("thumb")).toString());
 
         messages.push_back(msg);
     }
+    query->finish();
+}
+
+bool TelegramQuery::isDownloaded(const Message &message) {
+    if (message.downloaded) return true;
+    // Only databases the app has not indexed yet need a look at the disk.
+    if (mDownloadsIndexed || mSnapshot) return false;
+
+    return QFile(message.mediaUrl.mid(7)).exists();
 }
 
 CategorisedResult TelegramQuery::messageToResult(Category::SCPtr category, const Message &message) {
@@ -633,6 +1255,9 @@ CategorisedResult TelegramQuery::messageToResult(Category::SCPtr category, const
     case MessageMedia::typeMessageMediaEmpty:
         result["type"] = "text"; // no-i18n
         result["title"] = message.text.toStdString(); // no-i18n
+        if (!message.highlighted.isEmpty()) {
+            result["highlighted"] = message.highlighted.toStdString(); // no-i18n
+        }
         if (message.text.isEmpty()) {
             result["type"] = "unknown"; // no-i18n
         }
@@ -653,9 +1278,9 @@ CategorisedResult TelegramQuery::messageToResult(Category::SCPtr category, const
         result["type"] = "photo"; // no-i18n
         result["title"] = N_("Photo received");
 
-        if (QFile(message.mediaUrl.mid(7)).exists()) {
+        if (isDownloaded(message)) {
             result["mediaUrl"] = message.mediaUrl.toStdString(); // no-i18n
-            result["mediaThumb"] = message.mediaUrl.toStdString(); // no-i18n
+            result["mediaThumb"] = message.mediaThumb.toStdString(); // no-i18n
 /*
             if (mInPhotos) {
                 result["art"] = result["mediaThumb"];
@@ -670,7 +1295,7 @@ CategorisedResult TelegramQuery::messageToResult(Category::SCPtr category, const
         result["type"] = "video"; // no-i18n
         result["title"] = N_("Video received");
 
-        if (QFile(message.mediaUrl.mid(7)).exists()) {
+        if (isDownloaded(message)) {
             result["mediaUrl"] = message.mediaUrl.toStdString(); // no-i18n
             result["mediaThumb"] = message.mediaThumb.toStdString(); // no-i18n
         } else {
@@ -698,6 +1323,8 @@ CategorisedResult TelegramQuery::messageToResult(Category::SCPtr category, const
     result["from"] = from.toStdString(); // no-i18n
     result["date"] = date.toStdString(); // no-i18n
     result["avatar"] = (message.isChat ? message.chat.avatar : message.user.avatar).toStdString(); // no-i18n
+    // Orders cards of several accounts.
+    result["timestamp"] = Variant(int64_t(message.date)); // no-i18n
 
     return result;
 }
@@ -727,14 +1354,6 @@ CategorisedResult TelegramQuery::chatToResult(Category::SCPtr category, const Ch
     return result;
 }
 
-void TelegramQuery::push(SearchReplyProxy const &reply, ResultList &results) {
-    for (auto result : results) {
-        if (result["type"].get_string() != "unknown") {
-            if (!reply->push(result)) break;
-        }
-    }
-}
-
 void TelegramQuery::pushError(SearchReplyProxy const &reply, QString const &title, QString const &subtitle) {
      CategoryRenderer renderer(ERROR_TEMPLATE);
      auto category = reply->register_category("error", "", "", renderer);
@@ -5,14 +5,25 @@
 #include <unity/scopes/SearchMetadata.h>
 #include <unity/scopes/SearchQueryBase.h>
 
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSemaphore>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QString>
+#include <QStringList>
 
+#include <atomic>
 #include <set>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "config.h"
+#include "session.h"
+#include "snapshot.h"
+
+class ResultStream;
 
 using unity::scopes::CategorisedResult;
 using unity::scopes::Category;
@@ -49,30 +60,41 @@ struct Message {
     MessageMedia mediaType;
     QString mediaUrl;
     QString mediaThumb;
+    bool downloaded = false;
     QString text;
+    QString highlighted;
 };
 
 typedef std::map<qint64, User> UserMap;
 typedef std::map<qint64, Chat> ChatMap;
 typedef std::vector<Message> MessageList;
-typedef std::vector<CategorisedResult> ResultList;
+typedef std::vector<qint64> IdList;
 typedef unsigned int uint;
 
 class TelegramQuery : public SearchQueryBase
 {
 public:
-    TelegramQuery(CannedQuery const& query, SearchMetadata const& metadata, QString const& scopeDir);
+    // Without an account, every logged in account is searched.
+    TelegramQuery(CannedQuery const& query, SearchMetadata const& metadata, QString const& scopeDir,
+                  std::shared_ptr<TelegramSession> const& session, QString const& account = QString());
     ~TelegramQuery();
 
     virtual void cancelled() override;
     virtual void run(SearchReplyProxy const& reply) override;
     bool aggregated(std::string keyword);
 
+    // After run() of a query for one account.
+    bool wasCold() const { return mCold; }
+    bool fromSnapshot() const { return mSnapshot != nullptr; }
+
 private:
     const QString TAG = "Telegram:";
 
     SearchMetadata mMetadata;
     QString mScopeDir;
+    std::shared_ptr<TelegramSession> mSession;
+    QString mAccount;
+    bool mPartOfMerge;
     bool mIsAggregated = false;
     bool mInRecent = false;
     bool mInPhotos = false;
@@ -80,26 +102,70 @@ private:
     QSqlDatabase mDatabase;
     QString mOwnNumber;
     qint64 mOwnId = 0;
+    std::shared_ptr<Snapshot> mSnapshot;
+    bool mCold = false;
+    bool mDownloadsIndexed = false;
+    bool mThumbnailsIndexed = false;
+    bool mPeerSearchIndexed = false;
+    bool mDialogsIndexed = false;
+    bool mRecentMediaIndexed = false;
+
+    std::atomic<bool> mCancelled{false};
+    QMutex mHandleMutex;
+    void *mHandle = nullptr;
+    std::vector<TelegramQuery *> mParts;
+
+    // Shared by the parts of a merged query, see runAccounts().
+    struct Merge {
+        QSemaphore dialogsRead;         // released once by each part
+        QSemaphore categoriesReady;     // released for all parts at once
+        std::atomic<int> unreadTotal{0};
+    };
+    Merge *mMerge = nullptr;
+    bool mMergeJoined = false;
+    QString mStoppedAt;
+    int mInterrupted = 0;
+    int mDropped = 0;
+
+    void runAccounts(SearchReplyProxy const &reply, QStringList const &accounts, QElapsedTimer const &timer);
+    std::vector<std::string> registerMergedCategories(SearchReplyProxy const &reply, bool isSearch, int unreadTotal);
+    void awaitCategories(int unreadTotal, bool wait = true);
+    void setHandle(QSqlDatabase const &database);
+    bool stopAt(const char *phase);
+    bool interrupted();
+    void checkPlan(QString const &sql, QStringList const &allowed = QStringList());
+    QString messageSelectSql();
 
-    bool openDatabase(QString const &number);
     QString getDate(qint64 time);
     QString getAvatar(QString scopePath, qint64 userId);
-    QString getPrimaryPhoneNumber();
-    qint64 getPrimaryUserId();
-
-    void processDialogs(SearchReplyProxy const &reply, const QString &query, uint limit);
-    void getUsers(const QString &ids, UserMap &users);
-    void getChats(const QString &ids, ChatMap &chats);
-    void getMessages(const UserMap &users, const ChatMap &chats, const QString mids, MessageList &messages, bool hasMedia = false);
-
-    void processSearch(SearchReplyProxy const &reply, const QString &searchQuery, int limit);
+    QString getPeerAvatar(qint64 peerId, QString const &photo);
+    void setMedia(Message &msg, QString const &photo, QString const &video, QString const &downloaded,
+                  QString const &thumb);
+
+    QString unreadTitle(int unreadTotal);
+    void processDialogs(SearchReplyProxy const &reply, ResultStream &stream, const QString &query, uint limit);
+    bool getDialogs(uint limit, IdList &uids, IdList &cids, IdList &unreadIds, IdList &readIds, int &unreadTotal);
+    void getUsers(const IdList &ids, UserMap &users);
+    void getChats(const IdList &ids, ChatMap &chats);
+    void getMessages(const UserMap &users, const ChatMap &chats, const IdList &mids, MessageList &messages, bool hasMedia = false);
+
+    void getSnapshotDialogs(uint limit, IdList &uids, IdList &unreadIds, IdList &readIds, int &unreadTotal,
+                            UserMap &users, ChatMap &chats);
+    void getSnapshotMessages(const IdList &mids, MessageList &messages, bool hasMedia);
+    Message snapshotMessage(SurfacingSnapshot::Entry const &entry);
+
+    void processSearch(SearchReplyProxy const &reply, ResultStream &stream, const QString &searchQuery, int limit);
+    QString peerSearchSql(PeerType type);
+    void bindPeerSearch(QSqlQuery *query, QStringList const &words);
     void searchUsers(const QString &searchQuery, UserMap &users);
     void searchChats(const QString &searchQuery, ChatMap &chats);
-    void searchMessages(const QString searchQuery, int limit, MessageList &messages, QString &relatedUids, QString &relatedCids);
+    void searchMessages(const QString searchQuery, int limit, MessageList &messages, IdList &relatedUids, IdList &relatedCids);
+    void queryFoundMessages(QSqlQuery *query, MessageList &messages, IdList &relatedUids, IdList &relatedCids);
 
-    void queryUsers(const QString &sql, UserMap &users);
-    void queryChats(const QString &sql, ChatMap &chats);
+    void queryUsers(QSqlQuery *query, UserMap &users);
+    void queryChats(QSqlQuery *query, ChatMap &chats);
 
+    bool isDownloaded(const Message &message);
     CategorisedResult messageToResult(Category::SCPtr category, const Message &message);
     CategorisedResult userToResult(Category::SCPtr category, const User &user);
     CategorisedResult chatToResult(Category::SCPtr category, const Chat &chat);
@@ -108,5 +174,6 @@ private:
     void pushLogin(SearchReplyProxy const &reply);
     void pushAggregatedResult(SearchReplyProxy const &reply, CategorisedResult const &result);
     void pushNoMessagesToday(SearchReplyProxy const &reply);
-    void push(SearchReplyProxy const &reply, std::vector<CategorisedResult> &results);
+    bool pushResult(ResultStream &stream, CategorisedResult const &result);
+    bool pushMessages(ResultStream &stream, Category::SCPtr category, MessageList const &messages, uint limit);
 };
@@ -0,0 +1,32 @@
+#include <QDebug>
+#include <QRegExp>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+#include "queryplan.h"
+
+QStringList QueryPlan::fullScans(QSqlDatabase const &database, QString const &sql, QStringList const &allowed) {
+    QStringList scans;
+
+    QSqlQuery query(database);
+    if (!query.exec("EXPLAIN QUERY PLAN " + sql)) { // no-i18n
+        scans << "EXPLAIN failed: " + query.lastError().text(); // no-i18n
+        return scans;
+    }
+
+    // "SCAN TABLE Messages" on older SQLite, "SCAN Messages" on newer ones.
+    // Full-text queries show up as a scan of the virtual table, but they are
+    // answered from the index.
+    QRegExp scan("^SCAN (?:TABLE )?(\\S+)"); // no-i18n
+    const int detail = query.record().indexOf("detail"); // no-i18n
+    while (query.next()) {
+        const QString step = query.value(detail).toString();
+        if (scan.indexIn(step) < 0) continue;
+        if (step.contains("VIRTUAL TABLE")) continue; // no-i18n
+        if (allowed.contains(scan.cap(1), Qt::CaseInsensitive)) continue;
+
+        scans << step;
+    }
+    return scans;
+}
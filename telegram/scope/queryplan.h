@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+
+// Reads the plan SQLite picks for a statement and reports the steps that
+// walk a whole table or index instead of seeking into it.
+
+class QueryPlan
+{
+public:
+    // Tables listed in allowed may be scanned, e.g. because they are small.
+    static QStringList fullScans(QSqlDatabase const &database, QString const &sql,
+                                 QStringList const &allowed = QStringList());
+};
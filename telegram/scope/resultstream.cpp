@@ -0,0 +1,18 @@
+#include <unity/scopes/SearchReply.h>
+
+#include "resultstream.h"
+
+ResultStream::ResultStream(SearchReplyProxy const &reply, QElapsedTimer const &clock)
+        : mReply(reply), mClock(clock) {
+}
+
+bool ResultStream::push(CategorisedResult const &result) {
+    if (!mOpen) return false;
+
+    if (mFirstCard < 0) {
+        mFirstCard = mClock.elapsed();
+    }
+    mOpen = mReply->push(result);
+    mPushed++;
+    return mOpen;
+}
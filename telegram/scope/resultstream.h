@@ -0,0 +1,34 @@
+#pragma once
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/ReplyProxyFwd.h>
+
+#include <QElapsedTimer>
+
+using unity::scopes::CategorisedResult;
+using unity::scopes::SearchReplyProxy;
+
+// Hands cards to the Dash as soon as they are ready instead of collecting a
+// whole surface first, and remembers when the first one went out.
+
+class ResultStream
+{
+public:
+    ResultStream(SearchReplyProxy const &reply, QElapsedTimer const &clock);
+
+    // Returns false once the reply does not take any more results.
+    bool push(CategorisedResult const &result);
+
+    bool isOpen() const { return mOpen; }
+    int pushed() const { return mPushed; }
+    // Milliseconds on the query clock until the first card, -1 if none.
+    qint64 firstCard() const { return mFirstCard; }
+
+private:
+    SearchReplyProxy mReply;
+    QElapsedTimer const &mClock;
+
+    bool mOpen = true;
+    int mPushed = 0;
+    qint64 mFirstCard = -1;
+};
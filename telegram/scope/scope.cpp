@@ -5,14 +5,16 @@
 #include "preview.h"
 
 void TelegramScope::start(std::string const&) {
+    mSession = std::make_shared<TelegramSession>();
 }
 
 void TelegramScope::stop() {
+    mSession.reset();
 }
 
 SearchQueryBase::UPtr TelegramScope::search(CannedQuery const &q, SearchMetadata const &metadata) {
     const QString scopePath = QString::fromStdString(scope_directory());
-    SearchQueryBase::UPtr query(new TelegramQuery(q, metadata, scopePath));
+    SearchQueryBase::UPtr query(new TelegramQuery(q, metadata, scopePath, mSession));
     return query;
 }
 
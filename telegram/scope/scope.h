@@ -6,6 +6,10 @@
 #include <unity/scopes/ReplyProxyFwd.h>
 #include <unity/scopes/ScopeBase.h>
 
+#include <memory>
+
+#include "session.h"
+
 using namespace unity::scopes;
 
 class TelegramScope : public ScopeBase
@@ -16,4 +20,7 @@ public:
 
     PreviewQueryBase::UPtr preview(const Result &result, ActionMetadata const &metadata) override;
     virtual SearchQueryBase::UPtr search(CannedQuery const &q, SearchMetadata const &metadata) override;
+
+private:
+    std::shared_ptr<TelegramSession> mSession;
 };
@@ -1,5 +1,5 @@
 QT -= gui
-QT += sql
+QT += sql concurrent
 CONFIG += plugin no_plugin_name_prefix
 TEMPLATE = lib
 TARGET = com.ubuntu.telegram_sctelegram
@@ -19,7 +19,10 @@ PKG_CONFIG_LIBDIR=$$[QT_INSTALL_LIBS]/pkgconfig
 
 CONFIG += link_pkgconfig c++11
 PKGCONFIG += libunity-scopes
-LIBS += -lunity-scopes
+LIBS += -lunity-scopes -lsqlite3
+
+INCLUDEPATH += ../shared
+include(../shared/shared.pri)
 
 MOC_DIR = mocs
 OBJECTS_DIR = objs
@@ -27,12 +30,25 @@ OBJECTS_DIR = objs
 SOURCES += \
     scope.cpp \
     query.cpp \
-    preview.cpp
+    preview.cpp \
+    messageindex.cpp \
+    session.cpp \
+    queryplan.cpp \
+    resultstream.cpp \
+    snapshot.cpp
 
 HEADERS += \
     scope.h \
     query.h \
-    preview.h
+    preview.h \
+    messageindex.h \
+    session.h \
+    queryplan.h \
+    resultstream.h \
+    snapshot.h \
+    collectingreply.h \
+    ../shared/surfacingsnapshot.h \
+    ../shared/searchkeys.h
 
 target = $$TARGET
 target.path = /scope
@@ -0,0 +1,395 @@
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QThread>
+
+#include <sys/stat.h>
+
+#include "accountdatabase.h"
+#include "config.h"
+#include "session.h"
+#include "snapshot.h"
+
+bool TelegramSession::FileStamp::operator==(FileStamp const &other) const {
+    return device == other.device && inode == other.inode
+            && modified == other.modified && size == other.size;
+}
+
+TelegramSession::Connection::~Connection() {
+    statements.clear();
+    {
+        QSqlDatabase database = QSqlDatabase::database(name, false);
+        database.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+}
+
+TelegramSession::ThreadConnections::~ThreadConnections() {
+    qDeleteAll(accounts);
+    if (session) {
+        QMutexLocker locker(&session->mConnectionsMutex);
+        session->mAllConnections.removeOne(this);
+    }
+}
+
+TelegramSession::TelegramSession() : mChecksPlans(DEBUG) {
+}
+
+TelegramSession::~TelegramSession() {
+    if (mConnections.hasLocalData()) {
+        mConnections.setLocalData(0);
+    }
+
+    // Once QThreadStorage is gone, threads that exit later only warn and
+    // leak their data, so the connections of the other query threads are
+    // closed here. The scope has stopped, none of them is in a query.
+    QList<ThreadConnections *> connections;
+    {
+        QMutexLocker locker(&mConnectionsMutex);
+        connections.swap(mAllConnections);
+    }
+    for (auto thread: connections) {
+        thread->session = nullptr;
+        delete thread;
+    }
+}
+
+QStringList TelegramSession::accounts() {
+    QMutexLocker locker(&mMutex);
+
+    FileStamp profiles;
+    if (!stamp(PROFILES_PATH, profiles)) {
+        qCritical() << "profiles db: file not found";
+        mProfilesStamp = FileStamp();
+        mNumbers.clear();
+        return mNumbers;
+    }
+    if (profiles != mProfilesStamp) {
+        const QStringList numbers = AccountDatabase::phoneNumbers(PROFILES_PATH);
+        if (DEBUG) {
+            for (auto &number: numbers) {
+                qDebug() << QString("profile: *%1").arg(number.mid(number.length() - 3, 3));
+            }
+        }
+        if (!numbers.isEmpty()) {
+            mProfilesStamp = profiles;
+        }
+        mNumbers = numbers;
+
+        // Accounts that were logged out start from scratch if they come back.
+        for (auto it = mAccounts.begin(); it != mAccounts.end();) {
+            if (mNumbers.contains(it.key())) {
+                ++it;
+            } else {
+                it = mAccounts.erase(it);
+            }
+        }
+    }
+    return mNumbers;
+}
+
+bool TelegramSession::acquire(QString const &number, qint64 &ownId, QSqlDatabase &database, bool &cold) {
+    cold = false;
+
+    FileStamp data;
+    if (!stamp(DATABASE_PATH_FMT.arg(number), data)) {
+        qCritical() << "telegram db: file not found";
+        return false;
+    }
+
+    // Only the account's state is read and updated under the lock. Opening
+    // the database and reading the own id happen outside it, so that a cold
+    // account does not hold up queries on the others.
+    quint64 generation;
+    qint64 knownId;
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mAccounts.contains(number)) {
+            cold = true;
+        }
+        Account &account = mAccounts[number];
+
+        // Writes by the app are picked up by SQLite itself, a new connection
+        // is only needed when the file was replaced.
+        if (account.generation == 0 || data.device != account.databaseStamp.device || data.inode != account.databaseStamp.inode) {
+            account.databaseStamp = data;
+            account.ownId = 0;
+            account.indexVersion = 0;
+            account.generation = ++mGeneration;
+        }
+        generation = account.generation;
+        knownId = account.ownId;
+    }
+
+    if (!connection(number, generation, database, cold)) {
+        return false;
+    }
+
+    if (knownId == 0) {
+        knownId = readOwnUserId(number, database);
+        cold = true;
+
+        // Kept unless the file was replaced or the account logged out since.
+        QMutexLocker locker(&mMutex);
+        auto account = mAccounts.find(number);
+        if (account != mAccounts.end() && account->generation == generation) {
+            account->ownId = knownId;
+        }
+    }
+    ownId = knownId;
+
+    current()->statements.resetCounts();
+    return true;
+}
+
+TelegramSession::Connection *TelegramSession::current() {
+    return mConnections.hasLocalData() ? mConnections.localData()->current : nullptr;
+}
+
+QSqlQuery *TelegramSession::statement(QString const &sql) {
+    Connection *connection = current();
+    if (!connection) {
+        return 0;
+    }
+
+    QSqlQuery *query = connection->statements.statement(sql);
+    if (!query) {
+        qCritical().noquote() << TAG << "could not prepare:" << connection->statements.lastError();
+    }
+    return query;
+}
+
+bool TelegramSession::hasIndex(int version) {
+    if (!current()) {
+        return false;
+    }
+    const QString number = mConnections.localData()->number;
+    {
+        QMutexLocker locker(&mMutex);
+        if (mAccounts.value(number).indexVersion >= version) {
+            return true;
+        }
+    }
+
+    // Versions only go up, so this is only read until the app has caught up.
+    QSqlQuery *table = statement("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'General'"); // no-i18n
+    const bool hasTable = table && table->exec() && table->next();
+    if (table) table->finish();
+    if (!hasTable) {
+        return false;
+    }
+
+    QSqlQuery *query = statement("SELECT gvalue FROM General WHERE gkey = 'scopeIndexVersion'"); // no-i18n
+    int latest = 0;
+    if (query && query->exec() && query->next()) {
+        latest = query->value(0).toInt();
+    }
+    if (query) query->finish();
+
+    QMutexLocker locker(&mMutex);
+    if (!mAccounts.contains(number)) {
+        return latest >= version;
+    }
+    Account &account = mAccounts[number];
+    account.indexVersion = qMax(account.indexVersion, latest);
+    return account.indexVersion >= version;
+}
+
+void TelegramSession::release() {
+    Connection *connection = current();
+    if (!connection) {
+        return;
+    }
+
+    connection->statements.release();
+}
+
+std::shared_ptr<Snapshot> TelegramSession::snapshot() {
+    if (!current()) {
+        return nullptr;
+    }
+    const QString number = mConnections.localData()->number;
+
+    QMutexLocker locker(&mMutex);
+    if (!mAccounts.contains(number)) {
+        return nullptr;
+    }
+    Account &account = mAccounts[number];
+
+    // The app replaces the file on every write, so a changed stamp is a new
+    // snapshot and an unchanged one is still mapped.
+    const QString path = CONFIG_PATH + "/" + number + "/" + SurfacingSnapshot::SNAPSHOT_FILE_NAME;
+    FileStamp latest;
+    if (!stamp(path, latest)) {
+        account.snapshotStamp = FileStamp();
+        account.snapshot.reset();
+        return nullptr;
+    }
+    if (latest != account.snapshotStamp) {
+        account.snapshotStamp = latest;
+        account.snapshot = Snapshot::open(path);
+    }
+    if (!account.snapshot) {
+        return nullptr;
+    }
+
+    const qint64 modified = SurfacingSnapshot::databaseModified(QFile::encodeName(DATABASE_PATH_FMT.arg(number)));
+    if (modified > account.snapshot->sourceModified()) {
+        if (DEBUG) qDebug().noquote() << TAG << "snapshot stale by" << (modified - account.snapshot->sourceModified()) / 1000000 << "ms"; // no-i18n
+        return nullptr;
+    }
+    return account.snapshot;
+}
+
+void TelegramSession::statementCounts(int &prepared, int &reused) {
+    prepared = 0;
+    reused = 0;
+    if (Connection *connection = current()) {
+        prepared = connection->statements.prepared();
+        reused = connection->statements.reused();
+    }
+}
+
+void TelegramSession::report(bool cold, bool fromSnapshot, qint64 elapsed, qint64 firstCard) {
+    int prepared = 0;
+    int reused = 0;
+    qint64 prepareTime = 0;
+    if (Connection *connection = current()) {
+        prepared = connection->statements.prepared();
+        reused = connection->statements.reused();
+        prepareTime = connection->statements.prepareTime();
+    }
+
+    QMutexLocker locker(&mStatsMutex);
+    if (fromSnapshot) {
+        mSnapshotCount++;
+        mSnapshotTotal += elapsed;
+    } else if (cold) {
+        mColdCount++;
+        mColdTotal += elapsed;
+    } else {
+        mWarmCount++;
+        mWarmTotal += elapsed;
+    }
+    if (firstCard >= 0) {
+        mFirstCardCount++;
+        mFirstCardTotal += firstCard;
+    }
+
+    qDebug().noquote() << TAG << (fromSnapshot ? "snapshot" : cold ? "cold" : "warm") << "query took" << elapsed << "ms," // no-i18n
+                       << "average cold" << (mColdCount ? mColdTotal / mColdCount : 0) << "ms over" << mColdCount // no-i18n
+                       << ", warm" << (mWarmCount ? mWarmTotal / mWarmCount : 0) << "ms over" << mWarmCount // no-i18n
+                       << ", snapshot" << (mSnapshotCount ? mSnapshotTotal / mSnapshotCount : 0) << "ms over" << mSnapshotCount // no-i18n
+                       << "; first card after" << firstCard << "ms, average" // no-i18n
+                       << (mFirstCardCount ? mFirstCardTotal / mFirstCardCount : 0) << "ms" // no-i18n
+                       << "; prepared" << prepared << "statements in" << prepareTime / 1000 << "us, reused" << reused; // no-i18n
+}
+
+void TelegramSession::cancelled(QString const &phase, int interrupted, int dropped) {
+    QMutexLocker locker(&mStatsMutex);
+    mCancelledCount++;
+    mInterruptedTotal += interrupted;
+    mDroppedTotal += dropped;
+
+    qDebug().noquote() << TAG << "query cancelled at" << phase << "with" << interrupted << "statements interrupted and" // no-i18n
+                       << dropped << "results dropped, so far" << mCancelledCount << "queries," << mInterruptedTotal // no-i18n
+                       << "statements and" << mDroppedTotal << "results saved"; // no-i18n
+}
+
+bool TelegramSession::stamp(QString const &path, FileStamp &stamp) {
+    struct stat info;
+    if (stat(QFile::encodeName(path).constData(), &info) != 0) {
+        return false;
+    }
+
+    stamp.device = info.st_dev;
+    stamp.inode = info.st_ino;
+    stamp.modified = qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    stamp.size = info.st_size;
+    return true;
+}
+
+bool TelegramSession::connection(QString const &number, quint64 generation, QSqlDatabase &database, bool &cold) {
+    if (!mConnections.hasLocalData()) {
+        ThreadConnections *created = new ThreadConnections;
+        created->session = this;
+        {
+            QMutexLocker locker(&mConnectionsMutex);
+            mAllConnections << created;
+        }
+        mConnections.setLocalData(created);
+    }
+    ThreadConnections *connections = mConnections.localData();
+
+    Connection *connection = connections->accounts.value(number);
+    if (!connection || connection->generation != generation) {
+        Connection *next = new Connection;
+        next->generation = generation;
+        next->name = QString("tg-data-%1-%2-%3") // no-i18n
+                .arg(quintptr(this)).arg(quintptr(QThread::currentThreadId())).arg(generation);
+        next->statements.setConnectionName(next->name);
+
+        bool opened;
+        {
+            QSqlDatabase data = QSqlDatabase::addDatabase("QSQLITE", next->name);
+            opened = AccountDatabase::open(data, DATABASE_PATH_FMT.arg(number), AccountDatabase::ReadOnly);
+        }
+        if (!opened) {
+            qCritical() << "telegram db: failed to open";
+            delete next;
+            return false;
+        }
+
+        delete connection;
+        connections->accounts.insert(number, next);
+        connection = next;
+        cold = true;
+    }
+
+    connections->number = number;
+    connections->current = connection;
+    database = QSqlDatabase::database(connection->name, false);
+    return true;
+}
+
+qint64 TelegramSession::readOwnUserId(QString const &number, QSqlDatabase const &database) {
+    qint64 userId = 0;
+    QString trimmedPhone = (number.at(0) == '+') ? number.mid(1) : number;
+
+    QSqlQuery query(database);
+    query.prepare("SELECT id FROM Users WHERE phone = :phone");
+    query.bindValue(":phone", trimmedPhone);
+    if (query.exec() && query.first()) {
+        userId = query.value(query.record().indexOf("id")).toInt();
+    }
+
+    return userId;
+}
+
+bool TelegramSession::checksPlans() {
+    QMutexLocker locker(&mStatsMutex);
+    return mChecksPlans;
+}
+
+void TelegramSession::setChecksPlans(bool checks) {
+    QMutexLocker locker(&mStatsMutex);
+    mChecksPlans = checks;
+}
+
+void TelegramSession::fullScan(QString const &sql, QString const &step) {
+    qCritical().noquote() << TAG << "full scan:" << step << "in" << sql; // no-i18n
+
+    QMutexLocker locker(&mStatsMutex);
+    const QString scan = step + " in " + sql; // no-i18n
+    if (!mFullScans.contains(scan)) {
+        mFullScans << scan;
+    }
+}
+
+QStringList TelegramSession::fullScans() {
+    QMutexLocker locker(&mStatsMutex);
+    return mFullScans;
+}
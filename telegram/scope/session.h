@@ -0,0 +1,146 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QThreadStorage>
+
+#include "statementcache.h"
+
+#include <memory>
+
+#include <sys/types.h>
+
+class Snapshot;
+
+// State shared by all queries between TelegramScope::start() and stop():
+// the logged in profiles and, for each account, the own user id and one
+// read-only connection to its database per query thread. Everything is kept
+// until the files it was read from change on disk.
+//
+// A thread works on one account at a time, the one it last acquired;
+// statement(), hasIndex() and snapshot() are about that account.
+
+class TelegramSession
+{
+public:
+    TelegramSession();
+    ~TelegramSession();
+
+    // Phone numbers of the logged in accounts, in the order they were added.
+    QStringList accounts();
+
+    // Fills in the own user id of the account and a connection usable from
+    // the calling thread. Returns false when the account's database can not
+    // be opened. cold is set when anything had to be (re)loaded for this call.
+    bool acquire(QString const &number, qint64 &ownId, QSqlDatabase &database, bool &cold);
+
+    // Prepared statement for the calling thread's connection, kept for as
+    // long as the connection, so callers keep the SQL text fixed and bind
+    // everything that varies. Returns 0 if the statement does not prepare.
+    QSqlQuery *statement(QString const &sql);
+    // Resets the calling thread's statements so they hold no read lock.
+    void release();
+
+    // Whether the app has upgraded the account database to at least this
+    // version of its scope index, see config.h.
+    bool hasIndex(int version);
+
+    // The app's surfacing snapshot of the account from the last acquire(),
+    // or null if there is none or the database changed after it was taken.
+    std::shared_ptr<Snapshot> snapshot();
+
+    // fromSnapshot: answered from the snapshot, timed apart from SQL queries.
+    void report(bool cold, bool fromSnapshot, qint64 elapsed, qint64 firstCard);
+    // Statements the calling thread prepared and reused since acquire().
+    void statementCounts(int &prepared, int &reused);
+    // Accounts for the work a cancelled query did not do.
+    void cancelled(QString const &phase, int interrupted, int dropped);
+
+    // Whether queries read the plan of each statement before they run it,
+    // see TelegramQuery::checkPlan(). On in DEBUG builds and in scope-bench.
+    bool checksPlans();
+    void setChecksPlans(bool checks);
+    // Records a step of a plan that walks a whole table or index.
+    void fullScan(QString const &sql, QString const &step);
+    // Every one recorded, as "<step> in <sql>".
+    QStringList fullScans();
+
+private:
+    struct FileStamp {
+        dev_t device = 0;
+        ino_t inode = 0;
+        qint64 modified = 0;
+        qint64 size = -1;
+
+        bool operator==(FileStamp const &other) const;
+        bool operator!=(FileStamp const &other) const { return !(*this == other); }
+    };
+
+    struct Account {
+        FileStamp databaseStamp;
+        qint64 ownId = 0;
+        quint64 generation = 0;
+        int indexVersion = 0;
+
+        FileStamp snapshotStamp;
+        std::shared_ptr<Snapshot> snapshot;
+    };
+
+    struct Connection {
+        QString name;
+        quint64 generation = 0;
+        StatementCache statements;
+
+        ~Connection();
+    };
+
+    // The calling thread's connections by account, and the account it
+    // acquired last. Deleted by QThreadStorage when the thread exits, or by
+    // the session when it goes first.
+    struct ThreadConnections {
+        TelegramSession *session = nullptr;
+        QHash<QString, Connection *> accounts;
+        QString number;
+        Connection *current = nullptr;
+
+        ~ThreadConnections();
+    };
+
+    const QString TAG = "Telegram:";
+
+    static bool stamp(QString const &path, FileStamp &stamp);
+    qint64 readOwnUserId(QString const &number, QSqlDatabase const &database);
+    bool connection(QString const &number, quint64 generation, QSqlDatabase &database, bool &cold);
+    Connection *current();
+
+    QMutex mMutex;
+    FileStamp mProfilesStamp;
+    QStringList mNumbers;
+    QHash<QString, Account> mAccounts;
+    quint64 mGeneration = 0;
+
+    QThreadStorage<ThreadConnections *> mConnections;
+    QMutex mConnectionsMutex;
+    QList<ThreadConnections *> mAllConnections;
+
+    QMutex mStatsMutex;
+    qint64 mColdCount = 0;
+    qint64 mColdTotal = 0;
+    qint64 mWarmCount = 0;
+    qint64 mWarmTotal = 0;
+    qint64 mSnapshotCount = 0;
+    qint64 mSnapshotTotal = 0;
+    qint64 mFirstCardCount = 0;
+    qint64 mFirstCardTotal = 0;
+    qint64 mCancelledCount = 0;
+    qint64 mInterruptedTotal = 0;
+    qint64 mDroppedTotal = 0;
+
+    bool mChecksPlans;
+    QStringList mFullScans;
+};
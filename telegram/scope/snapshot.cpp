@@ -0,0 +1,72 @@
+#include <QDebug>
+
+#include <cstring>
+
+#include "config.h"
+#include "snapshot.h"
+
+using namespace SurfacingSnapshot;
+
+Snapshot::Snapshot(QString const &path)
+        : mFile(path) {
+}
+
+Snapshot::~Snapshot() {
+    // QFile unmaps whatever is still mapped.
+}
+
+std::shared_ptr<Snapshot> Snapshot::open(QString const &path) {
+    std::shared_ptr<Snapshot> snapshot(new Snapshot(path));
+    if (!snapshot->map()) {
+        return nullptr;
+    }
+    return snapshot;
+}
+
+bool Snapshot::map() {
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = mFile.size();
+    if (size < qint64(sizeof(Header))) {
+        qCritical().noquote() << TAG << "snapshot truncated";
+        return false;
+    }
+
+    uchar *data = mFile.map(0, size);
+    // The mapping stays valid after the file is closed or replaced.
+    mFile.close();
+    if (!data) {
+        qCritical().noquote() << TAG << "could not map snapshot";
+        return false;
+    }
+    mHeader = reinterpret_cast<const Header *>(data);
+
+    if (memcmp(mHeader->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || mHeader->version != SNAPSHOT_VERSION) {
+        if (DEBUG) qDebug().noquote() << TAG << "snapshot version" << mHeader->version << "not supported";
+        return false;
+    }
+
+    const qint64 entries = qint64(mHeader->dialogCount) + mHeader->photoCount;
+    if (qint64(sizeof(Header)) + entries * qint64(sizeof(Entry)) + mHeader->stringsSize != size) {
+        qCritical().noquote() << TAG << "snapshot size mismatch";
+        return false;
+    }
+
+    mEntries = reinterpret_cast<const Entry *>(data + sizeof(Header));
+    mStrings = reinterpret_cast<const char *>(mEntries + entries);
+    return true;
+}
+
+bool Snapshot::covers(uint count) const {
+    return count <= mHeader->dialogCount || mHeader->dialogCount < mHeader->dialogLimit;
+}
+
+QString Snapshot::string(StringRef const &ref) const {
+    // Offsets come from a file, never trust them past the string section.
+    if (ref.size == 0 || ref.offset > mHeader->stringsSize || ref.size > mHeader->stringsSize - ref.offset) {
+        return QString();
+    }
+    return QString::fromUtf8(mStrings + ref.offset, ref.size);
+}
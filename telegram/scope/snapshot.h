@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+#include <memory>
+
+#include "surfacingsnapshot.h"
+
+// Read-only mapping of the surfacing snapshot the app writes next to the
+// account database (see shared/surfacingsnapshot.h). Queries keep a reference
+// for as long as they read from it, the session drops its own when the file
+// is replaced.
+
+class Snapshot
+{
+public:
+    ~Snapshot();
+
+    // Returns null when there is no snapshot or it is not one this scope reads.
+    static std::shared_ptr<Snapshot> open(QString const &path);
+
+    qint64 sourceModified() const { return mHeader->sourceModified; }
+    uint unreadTotal() const { return mHeader->unreadTotal; }
+
+    // Whether the first count dialogs are all in the snapshot.
+    bool covers(uint count) const;
+
+    uint dialogCount() const { return mHeader->dialogCount; }
+    SurfacingSnapshot::Entry const &dialog(uint i) const { return mEntries[i]; }
+    uint photoCount() const { return mHeader->photoCount; }
+    SurfacingSnapshot::Entry const &photo(uint i) const { return mEntries[mHeader->dialogCount + i]; }
+
+    QString string(SurfacingSnapshot::StringRef const &ref) const;
+
+private:
+    Snapshot(QString const &path);
+    bool map();
+
+    const QString TAG = "Telegram:";
+
+    QFile mFile;
+    const SurfacingSnapshot::Header *mHeader = nullptr;
+    const SurfacingSnapshot::Entry *mEntries = nullptr;
+    const char *mStrings = nullptr;
+};
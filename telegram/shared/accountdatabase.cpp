@@ -0,0 +1,75 @@
+#include "accountdatabase.h"
+
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+
+namespace AccountDatabase {
+
+// Negative cache sizes are in KiB. Mapped pages are shared between the
+// processes reading the file, copied ones are not.
+static const char *CACHE_SIZE_PRAGMA = "PRAGMA cache_size = -2048";
+static const char *MMAP_SIZE_PRAGMA = "PRAGMA mmap_size = 67108864";
+static const int BUSY_TIMEOUT = 10000;
+
+bool open(QSqlDatabase &db, const QString &path, Mode mode)
+{
+    db.setDatabaseName(path);
+    db.setConnectOptions(mode == ReadOnly? QString("QSQLITE_OPEN_READONLY")
+                                         : QString("QSQLITE_BUSY_TIMEOUT=%1").arg(BUSY_TIMEOUT));
+    if(!db.open())
+    {
+        qCritical() << "account db: could not open" << path << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    query.exec(CACHE_SIZE_PRAGMA);
+    query.exec(MMAP_SIZE_PRAGMA);
+    if(mode == ReadOnly)
+    {
+        query.exec("PRAGMA query_only = 1");
+    }
+    else
+    {
+        // The journal mode belongs to TelegramQML and is only checked: in WAL
+        // readers never wait for the indexer's batches and the other way
+        // round. Switching it here would leave the confined scope's
+        // read-only connection depending on a -shm file it cannot create.
+        if(query.exec("PRAGMA journal_mode") && query.next() && query.value(0).toString() != "wal")
+            qWarning() << "account db: not in WAL mode:" << query.value(0).toString();
+    }
+    return true;
+}
+
+QStringList phoneNumbers(const QString &profilesPath)
+{
+    QStringList numbers;
+    const QString name = QString("account-profiles-%1").arg(quintptr(QThread::currentThreadId()));
+
+    {
+        QSqlDatabase profiles = QSqlDatabase::addDatabase("QSQLITE", name);
+        profiles.setDatabaseName(profilesPath);
+        profiles.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+        if(!profiles.open())
+        {
+            qCritical() << "profiles db: failed to open";
+        }
+        else
+        {
+            QSqlQuery query(profiles);
+            if(!query.exec("SELECT number FROM Profiles ORDER BY rowid"))
+                qCritical() << "profiles db: failed to query phone numbers";
+            while(query.next())
+                numbers << query.value(0).toString();
+        }
+        profiles.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+
+    return numbers;
+}
+
+}
@@ -0,0 +1,26 @@
+#ifndef ACCOUNTDATABASE_H
+#define ACCOUNTDATABASE_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+
+// Opening the databases TelegramQML writes. Every connection gets the same
+// settings, so a tuning change reaches the app's indexer and the scope alike.
+
+namespace AccountDatabase {
+
+enum Mode {
+    ReadOnly,   // the scope's queries
+    ReadWrite   // the app's scope indexer, next to TelegramQML's own connection
+};
+
+// Opens a connection already added under a name of the caller's choosing.
+bool open(QSqlDatabase &db, const QString &path, Mode mode);
+
+// Phone numbers of the logged in accounts, in the order they were added.
+QStringList phoneNumbers(const QString &profilesPath);
+
+}
+
+#endif // ACCOUNTDATABASE_H
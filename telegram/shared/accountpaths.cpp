@@ -0,0 +1,39 @@
+#include "accountpaths.h"
+
+#ifndef TELEGRAM_HOME
+#define TELEGRAM_HOME "/home/phablet"
+#endif
+
+namespace AccountPaths {
+
+QString configPath()
+{
+    return TELEGRAM_HOME "/.config/com.ubuntu.telegram";
+}
+
+QString cachePath()
+{
+    return TELEGRAM_HOME "/.cache/com.ubuntu.telegram";
+}
+
+QString profilesPath(const QString &config)
+{
+    return config + "/profiles.sqlite";
+}
+
+QString accountPath(const QString &number, const QString &config)
+{
+    return config + "/" + number;
+}
+
+QString databasePath(const QString &number, const QString &config)
+{
+    return accountPath(number, config) + "/database.db";
+}
+
+QString downloadsPath(const QString &number, const QString &cache)
+{
+    return cache + "/" + number + "/downloads";
+}
+
+}
@@ -0,0 +1,23 @@
+#ifndef ACCOUNTPATHS_H
+#define ACCOUNTPATHS_H
+
+#include <QString>
+
+// Where the app keeps an account's files. The app passes its own config and
+// cache directories; the scope and the push helper run confined with a
+// different home and use the defaults under TELEGRAM_HOME, which the
+// benchmarks point at a scratch home.
+
+namespace AccountPaths {
+
+QString configPath();
+QString cachePath();
+
+QString profilesPath(const QString &config = configPath());
+QString accountPath(const QString &number, const QString &config = configPath());
+QString databasePath(const QString &number, const QString &config = configPath());
+QString downloadsPath(const QString &number, const QString &cache = cachePath());
+
+}
+
+#endif // ACCOUNTPATHS_H
@@ -0,0 +1,61 @@
+#ifndef BENCHOPTIONS_H
+#define BENCHOPTIONS_H
+
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Command line and statistics of the standalone benchmarks: emoji-bench,
+// push-bench and scope-bench. None of them is part of the click package.
+
+namespace BenchOptions {
+
+// Walks the "--name value" options of args, the names in flags take no
+// value. handle(name, value) is called for each one, with an empty value
+// for flags, and returns false for a name it does not know. Returns -1 once
+// all are handled; otherwise usage has been printed and the result is the
+// exit status: 0 for --help, wherever it is, 1 for an unknown option or a
+// missing value.
+template<typename Handle>
+inline int parse(const QStringList &args, const char *usage, const QStringList &flags, Handle handle)
+{
+    if(args.indexOf("--help", 1) > 0)
+    {
+        fputs(usage, stdout);
+        return 0;
+    }
+
+    for(int i = 1; i < args.size(); i++)
+    {
+        const QString &name = args[i];
+        const bool flag = flags.contains(name);
+        if(!flag && i + 1 >= args.size())
+        {
+            fputs(usage, stderr);
+            return 1;
+        }
+        if(!handle(name, flag? QString() : args[++i]))
+        {
+            fputs(usage, stderr);
+            return 1;
+        }
+    }
+    return -1;
+}
+
+// The duration at p, from 0 to 1, of nanoseconds sorted ascending, in units
+// of unit nanoseconds.
+inline double percentile(const std::vector<qint64> &sorted, double p, double unit)
+{
+    if(sorted.empty())
+        return 0;
+    const size_t index = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+    return sorted[index] / unit;
+}
+
+}
+
+#endif // BENCHOPTIONS_H
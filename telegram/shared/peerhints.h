@@ -0,0 +1,96 @@
+#ifndef PEERHINTS_H
+#define PEERHINTS_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cstring>
+
+// On-disk layout of peer.hints, written by the app next to profiles.sqlite
+// and mapped read-only by the push helper. It holds the display name and
+// avatar of every dialog peer of every logged in account, so that a
+// notification gets its icon without opening SQLite or listing directories.
+//
+//     Header
+//     Entry[count]         sorted by peer type, peer id, then account
+//     char[stringsSize]    UTF-8 strings referenced by the entries
+//
+// Integers are in host byte order, the file never leaves the device. Any
+// change to the layout bumps HINTS_VERSION; readers ignore other versions.
+
+namespace PeerHints {
+
+const char HINTS_MAGIC[4] = { 'T', 'G', 'P', 'H' };
+const quint32 HINTS_VERSION = 2;
+const char HINTS_FILE_NAME[] = "peer.hints";
+
+// A user and a chat can have the same id, entries are told apart by type.
+enum PeerType {
+    PEER_USER = 0,
+    PEER_CHAT = 1
+};
+
+struct StringRef {
+    quint32 offset;     // into the string section
+    quint32 size;       // in bytes
+};
+
+struct Header {
+    char magic[4];
+    quint32 version;
+    quint32 count;
+    quint32 stringsSize;
+};
+
+struct Entry {
+    quint32 peerType;   // PeerType
+    quint32 reserved;   // zero
+    qint64 peerId;      // user or chat id
+    StringRef account;  // phone number of the account the peer belongs to
+    StringRef name;     // chat title, or first and last name of a user
+    StringRef avatar;   // local path of the small profile photo, empty unless downloaded
+};
+
+static_assert(sizeof(Header) == 16, "peer hints header layout changed");
+static_assert(sizeof(Entry) == 40, "peer hints entry layout changed");
+
+// Checks a mapped or read file and points into it, false if it is not one of
+// this version or its sizes do not add up.
+inline bool parse(const uchar *data, qint64 size, const Header *&header, const Entry *&entries, const char *&strings)
+{
+    if(!data || size < qint64(sizeof(Header)))
+        return false;
+
+    header = reinterpret_cast<const Header *>(data);
+    if(memcmp(header->magic, HINTS_MAGIC, sizeof(HINTS_MAGIC)) != 0 || header->version != HINTS_VERSION)
+        return false;
+    if(qint64(sizeof(Header)) + qint64(header->count) * qint64(sizeof(Entry)) + header->stringsSize != size)
+        return false;
+
+    entries = reinterpret_cast<const Entry *>(data + sizeof(Header));
+    strings = reinterpret_cast<const char *>(entries + header->count);
+    return true;
+}
+
+// First entry of the peer, null without one.
+inline const Entry *find(const Header *header, const Entry *entries, PeerType peerType, qint64 peerId)
+{
+    const Entry *end = entries + header->count;
+    const Entry *entry = std::lower_bound(entries, end, peerId, [peerType](const Entry &entry, qint64 peerId) {
+        return entry.peerType != quint32(peerType) ? entry.peerType < quint32(peerType) : entry.peerId < peerId;
+    });
+    return entry != end && entry->peerType == quint32(peerType) && entry->peerId == peerId ? entry : 0;
+}
+
+inline QString string(const Header *header, const char *strings, const StringRef &ref)
+{
+    // Offsets come from a file, never trust them past the string section.
+    if(ref.size == 0 || ref.offset > header->stringsSize || ref.size > header->stringsSize - ref.offset)
+        return QString();
+    return QString::fromUtf8(strings + ref.offset, ref.size);
+}
+
+}
+
+#endif // PEERHINTS_H
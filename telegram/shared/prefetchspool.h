@@ -0,0 +1,87 @@
+#ifndef PREFETCHSPOOL_H
+#define PREFETCHSPOOL_H
+
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+// prefetch.spool in the app's cache directory: the push helper appends one
+// line per notification, the app takes the whole file when it starts or
+// comes back to the foreground and warms those dialogs, so that tapping the
+// notification opens a chat that is already loaded.
+//
+//     <account> <peer id> <c|u> <secs since epoch>\n
+//
+// The account is the phone number from the peer hints file, empty when the
+// peer is not in there. A line is written with a single append, which the
+// kernel keeps whole next to other helpers' lines.
+
+namespace PrefetchSpool {
+
+const char SPOOL_FILE_NAME[] = "prefetch.spool";
+const qint64 SPOOL_MAX_SIZE = 4096;     // pushes beyond this wait for the app to take the spool
+const qint64 SPOOL_MAX_AGE = 86400;     // seconds, older pushes are not worth warming for
+const int SPOOL_MAX_PEERS = 5;
+
+struct Record {
+    QString account;
+    qint64 peerId;
+    bool chat;
+    qint64 time;
+};
+
+inline bool append(const QString &path, const Record &record)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered))
+        return false;
+    if(file.size() >= SPOOL_MAX_SIZE)
+        return false;
+
+    const QByteArray line = QString("%1 %2 %3 %4\n").arg(record.account).arg(record.peerId)
+            .arg(record.chat? "c" : "u").arg(record.time).toUtf8();
+    return file.write(line) == line.size();
+}
+
+// Empties the spool and returns its peers, most recent push first, each
+// peer once and none older than SPOOL_MAX_AGE.
+inline QList<Record> take(const QString &path, qint64 now)
+{
+    // Renamed away first, a helper that runs meanwhile starts a new spool.
+    const QString taken = path + ".taken";
+    QFile::remove(taken);
+    if(!QFile::rename(path, taken))
+        return QList<Record>();
+
+    QFile file(taken);
+    QList<Record> records;
+    if(file.open(QIODevice::ReadOnly))
+    {
+        const QList<QByteArray> lines = file.readAll().split('\n');
+        for(int i = lines.size() - 1; i >= 0 && records.size() < SPOOL_MAX_PEERS; i--)
+        {
+            const QStringList fields = QString::fromUtf8(lines[i]).split(' ');
+            if(fields.size() != 4)
+                continue;
+
+            Record record = { fields[0], fields[1].toLongLong(), fields[2] == "c", fields[3].toLongLong() };
+            if(record.peerId == 0 || now - record.time > SPOOL_MAX_AGE)
+                continue;
+
+            bool seen = false;
+            foreach(const Record &other, records)
+                if(other.peerId == record.peerId && other.chat == record.chat && other.account == record.account)
+                    seen = true;
+            if(!seen)
+                records << record;
+        }
+        file.close();
+    }
+    file.remove();
+    return records;
+}
+
+}
+
+#endif // PREFETCHSPOOL_H
@@ -0,0 +1,98 @@
+#ifndef SEARCHKEYS_H
+#define SEARCHKEYS_H
+
+#include <QString>
+#include <QStringList>
+
+// Keys of the PeerSearchKeys table: the words of a user's or chat's name,
+// case-folded and stripped of diacritics, so that "zoe" finds "Zoë" and
+// "елена" finds "Елена" with a prefix seek. The app writes the keys and the
+// scope folds its queries with the same functions, any change here needs a
+// new scope index version so that existing keys are rebuilt.
+
+namespace SearchKeys {
+
+inline QString fold(const QString &text)
+{
+    // Compatibility decomposition splits accented letters into base letter
+    // and combining marks, and ligatures into their letters.
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString folded;
+    folded.reserve(decomposed.size());
+    for(QChar c: decomposed)
+    {
+        // Combining marks, including Arabic vowel signs.
+        if(c.category() == QChar::Mark_NonSpacing)
+            continue;
+
+        // Arabic yeh and kaf are interchangeable with the Persian forms,
+        // which keyboard a name was typed on should not matter.
+        if(c.unicode() == 0x064A || c.unicode() == 0x0649)
+            c = QChar(0x06CC);
+        else if(c.unicode() == 0x0643)
+            c = QChar(0x06A9);
+
+        folded += c;
+    }
+    return folded.toCaseFolded();
+}
+
+// Folded words of text, without duplicates. Anything but letters and digits
+// separates words.
+inline QStringList keys(const QString &text)
+{
+    QStringList keys;
+    QString word;
+    const QString folded = fold(text);
+    for(int i = 0; i <= folded.size(); i++)
+    {
+        if(i < folded.size() && folded.at(i).isLetterOrNumber())
+        {
+            word += folded.at(i);
+            continue;
+        }
+        if(!word.isEmpty() && !keys.contains(word))
+            keys << word;
+        word.clear();
+    }
+    return keys;
+}
+
+// Smallest string greater than every string starting with prefix, the upper
+// bound of a range scan for the prefix.
+inline QString prefixEnd(const QString &prefix)
+{
+    QString end = prefix;
+    while(!end.isEmpty() && end.at(end.size() - 1).unicode() == 0xFFFF)
+        end.chop(1);
+    if(end.isEmpty())
+        return QString(QChar(0xFFFF));
+
+    end[end.size() - 1] = QChar(end.at(end.size() - 1).unicode() + 1);
+    return end;
+}
+
+// Whether every query word is the start of one of the words of text.
+inline bool matches(const QStringList &words, const QString &text)
+{
+    const QStringList textKeys = keys(text);
+    for(const QString &word: words)
+    {
+        bool found = false;
+        for(const QString &key: textKeys)
+        {
+            if(key.startsWith(word))
+            {
+                found = true;
+                break;
+            }
+        }
+        if(!found)
+            return false;
+    }
+    return true;
+}
+
+}
+
+#endif // SEARCHKEYS_H
@@ -0,0 +1,26 @@
+# Account data code of the app, the push helper and the scope: where an
+# account's files are, which accounts are logged in, how their databases are
+# opened and prepared statement caching. The three are built on their own
+# (scope/build.sh, telegram.pro, snapcraft.yaml), so like asemantools.pri
+# this compiles the sources into each target that includes it.
+#
+# The database part is only added to targets that use Qt SQL; the push
+# helper does not load it.
+
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/accountpaths.h
+
+SOURCES += \
+    $$PWD/accountpaths.cpp
+
+contains(QT, sql) {
+    HEADERS += \
+        $$PWD/accountdatabase.h \
+        $$PWD/statementcache.h
+
+    SOURCES += \
+        $$PWD/accountdatabase.cpp \
+        $$PWD/statementcache.cpp
+}
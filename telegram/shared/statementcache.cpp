@@ -0,0 +1,88 @@
+#include "statementcache.h"
+
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlError>
+
+StatementCache::StatementCache() :
+    mPrepared(0),
+    mReused(0),
+    mPrepareTime(0)
+{
+}
+
+StatementCache::~StatementCache()
+{
+    clear();
+}
+
+void StatementCache::setConnectionName(const QString &name)
+{
+    mConnectionName = name;
+}
+
+QSqlQuery *StatementCache::statement(const QString &sql)
+{
+    QSqlQuery *query = mStatements.value(sql);
+    if(query)
+    {
+        mReused++;
+        return query;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    query = new QSqlQuery(QSqlDatabase::database(mConnectionName, false));
+    query->setForwardOnly(true);
+    if(!query->prepare(sql))
+    {
+        mLastError = query->lastError().text();
+        delete query;
+        return 0;
+    }
+
+    mPrepareTime += timer.nsecsElapsed();
+    mPrepared++;
+    mStatements.insert(sql, query);
+    return query;
+}
+
+QString StatementCache::lastError() const
+{
+    return mLastError;
+}
+
+void StatementCache::release()
+{
+    foreach(QSqlQuery *query, mStatements)
+        query->finish();
+}
+
+void StatementCache::clear()
+{
+    qDeleteAll(mStatements);
+    mStatements.clear();
+}
+
+void StatementCache::resetCounts()
+{
+    mPrepared = 0;
+    mReused = 0;
+    mPrepareTime = 0;
+}
+
+int StatementCache::prepared() const
+{
+    return mPrepared;
+}
+
+int StatementCache::reused() const
+{
+    return mReused;
+}
+
+qint64 StatementCache::prepareTime() const
+{
+    return mPrepareTime;
+}
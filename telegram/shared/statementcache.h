@@ -0,0 +1,45 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <QHash>
+#include <QSqlQuery>
+#include <QString>
+
+// Prepared statements of one connection, kept for as long as the connection,
+// so callers keep the SQL text fixed and bind everything that varies. Not
+// thread safe; a connection belongs to one thread anyway.
+
+class StatementCache
+{
+public:
+    StatementCache();
+    ~StatementCache();
+
+    // Must be set before the first statement() and not change after.
+    void setConnectionName(const QString &name);
+
+    // Null if the statement does not prepare, see lastError().
+    QSqlQuery *statement(const QString &sql);
+    QString lastError() const;
+
+    // Resets every statement so none holds a read lock.
+    void release();
+    // Deletes the statements, before the connection is removed.
+    void clear();
+
+    // Since the last resetCounts().
+    void resetCounts();
+    int prepared() const;
+    int reused() const;
+    qint64 prepareTime() const;     // in nanoseconds
+
+private:
+    QString mConnectionName;
+    QHash<QString, QSqlQuery *> mStatements;
+    QString mLastError;
+    int mPrepared;
+    int mReused;
+    qint64 mPrepareTime;
+};
+
+#endif // STATEMENTCACHE_H
@@ -0,0 +1,103 @@
+#ifndef SURFACINGSNAPSHOT_H
+#define SURFACINGSNAPSHOT_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include <sys/stat.h>
+
+// On-disk layout of surfacing.snapshot, written by the app next to an
+// account's database.db and mapped read-only by the scope. It holds what the
+// scope shows for an empty query, so that surfacing does not touch SQLite.
+//
+//     Header
+//     Entry[dialogCount]   top dialogs, most recent first
+//     Entry[photoCount]    latest downloaded photos, most recent first
+//     char[stringsSize]    UTF-8 strings referenced by the entries
+//
+// Integers are in host byte order, the file never leaves the device. Any
+// change to the layout bumps SNAPSHOT_VERSION; readers ignore other versions
+// and fall back to the database.
+
+namespace SurfacingSnapshot {
+
+const char SNAPSHOT_MAGIC[4] = { 'T', 'G', 'S', 'S' };
+const quint32 SNAPSHOT_VERSION = 4;
+const char SNAPSHOT_FILE_NAME[] = "surfacing.snapshot";
+
+enum EntryFlag {
+    EntryChat    = 0x01,    // peer is a chat, otherwise a user
+    EntryOut     = 0x02,
+    EntryUnread  = 0x04,
+    EntryPeer    = 0x08,    // the peer's row was found, names and avatar are set
+    EntryMessage = 0x10     // the message row was found, a dialog may not have one
+};
+
+struct StringRef {
+    quint32 offset;     // into the string section
+    quint32 size;       // in bytes
+};
+
+struct Header {
+    char magic[4];
+    quint32 version;
+    // Newest modification time of database.db and its WAL, in nanoseconds,
+    // taken before the snapshot was read. Anything newer on disk means the
+    // snapshot may be missing changes.
+    qint64 sourceModified;
+    qint64 written;     // msecs since epoch, informational
+    quint32 dialogCount;
+    quint32 dialogLimit;    // dialogCount < dialogLimit means every dialog is in
+    quint32 photoCount;
+    quint32 photoLimit;
+    quint32 stringsSize;
+    quint32 unreadTotal;    // unread messages over all dialogs, not just the ones in here
+};
+
+// One card: the top message of a dialog or a photo message, together with the
+// peer it is shown under (the chat, or the other user of a private chat).
+struct Entry {
+    qint64 messageId;
+    qint64 peerId;
+    qint64 date;        // secs since epoch
+    quint32 flags;
+    quint32 mediaType;  // MessageMedia class type
+    quint32 unreadCount;
+    quint32 reserved;
+
+    StringRef firstName;    // chat title for chats
+    StringRef lastName;
+    StringRef phone;
+    StringRef avatar;       // "<volume>_<local>" of the small profile photo, empty without one
+    StringRef text;
+    StringRef photo;        // "<volume>_<local>" of the first photo size
+    StringRef video;        // video id
+    StringRef file;         // local path of the photo or video, empty unless downloaded
+    StringRef thumb;        // local path of the photo's card thumbnail, empty without one
+};
+
+static_assert(sizeof(Header) == 48, "snapshot header layout changed");
+static_assert(sizeof(Entry) == 112, "snapshot entry layout changed");
+
+// The stamp both sides compare: newest modification time of the database
+// and its WAL in nanoseconds, 0 if neither exists.
+inline qint64 databaseModified(const QByteArray &databasePath)
+{
+    qint64 newest = 0;
+    const QByteArray paths[] = { databasePath, databasePath + "-wal" };
+    for(const QByteArray &path: paths)
+    {
+        struct stat info;
+        if(stat(path.constData(), &info) != 0)
+            continue;
+
+        const qint64 modified = qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        if(modified > newest)
+            newest = modified;
+    }
+    return newest;
+}
+
+}
+
+#endif // SURFACINGSNAPSHOT_H
@@ -129,7 +129,7 @@ defineTest(ubuntuAddPreTargetDep) {
     }
 
     !isEmpty(template_pot.depends) {
-        template_pot.commands=mkdir -p $$_PRO_FILE_PWD_/po && xgettext -o $$template_pot.target --qt --c++ --from-code=UTF-8 --add-comments=TRANSLATORS --keyword=tr --keyword=tr:1,2 --keyword=N_ $$template_pot.depends
+        template_pot.commands=mkdir -p $$_PRO_FILE_PWD_/po && xgettext -o $$template_pot.target --qt --c++ --from-code=UTF-8 --add-comments=TRANSLATORS --keyword=tr --keyword=tr:1,2 --keyword=N_ --keyword=NOOP_ --keyword=ngettext:1,2 $$template_pot.depends
 
         QMAKE_EXTRA_TARGETS+=template_pot
         ubuntuAddPreTargetDep($${template_pot.target})